@@ -0,0 +1,129 @@
+#ifndef FRACGEN_ADAPTIVE_HPP_DEFINED__
+#define FRACGEN_ADAPTIVE_HPP_DEFINED__
+
+#include "Color.h"
+#include "Types.h"
+
+#include <vector>
+
+#include <cmath>
+
+// Adaptive rendering of one block of image, similar to Mariani-Silver
+// algorithm. Border of block is calculated first. If all border points
+// belong to the same class (both diverged or converged to the same root
+// with the same number of iterations), interior is filled by interpolation
+// between left and right borders. Otherwise block is split into four
+// parts which share edges and every part is processed the same way.
+// Small features inside of uniform block are lost, so mode is meant for previews.
+class AdaptiveBlock {
+  // Points closer than that by argument are thought to be at the same root.
+  static constexpr FloatType RootArgTolerance = 0.1;
+  // Blocks of that size or smaller are calculated point by point.
+  static constexpr int MinSize = 4;
+
+  int Width;
+  int Height;
+  std::vector<PtColor> Pts;
+  std::vector<bool> Known;
+  IdxType Evaluated = 0;
+
+  static bool isSimilar(const PtColor &A, const PtColor &B) {
+    if (A.first != B.first)
+      return false;
+    if (!A.first)
+      return A.second.isCycled() == B.second.isCycled();
+    return A.second.getIters() == B.second.getIters() &&
+      std::abs(A.second.getArg() - B.second.getArg()) < RootArgTolerance;
+  }
+
+  template<typename EvalTy>
+  const PtColor &get(EvalTy &Eval, int X, int Y) {
+    IdxType Idx = Y * Width + X;
+    if (!Known[Idx]) {
+      Pts[Idx] = Eval(X, Y);
+      Known[Idx] = true;
+      ++Evaluated;
+    }
+    return Pts[Idx];
+  }
+
+  void interpolate(int X0, int X1, int Y0, int Y1) {
+    for (int Y = Y0 + 1; Y < Y1; ++Y) {
+      const PtColor &L = Pts[Y * Width + X0];
+      const PtColor &R = Pts[Y * Width + X1];
+      for (int X = X0 + 1; X < X1; ++X) {
+        IdxType Idx = Y * Width + X;
+        Known[Idx] = true;
+        if (!L.first) {
+          Pts[Idx] = L;
+          continue;
+        }
+        FloatType T = static_cast<FloatType>(X - X0) / (X1 - X0);
+        const PointColor &LC = L.second, &RC = R.second;
+        Pts[Idx] = PtColor(true, PointColor(LC.getArg() + T * (RC.getArg() - LC.getArg()),
+                                            LC.getNorm() + T * (RC.getNorm() - LC.getNorm()),
+                                            LC.getIters()));
+      }
+    }
+  }
+
+  // Bounds are inclusive.
+  template<typename EvalTy>
+  void refine(EvalTy &Eval, int X0, int X1, int Y0, int Y1) {
+    const PtColor &Ref = get(Eval, X0, Y0);
+    bool Uniform = true;
+    for (int X = X0; X <= X1; ++X) {
+      Uniform &= isSimilar(get(Eval, X, Y0), Ref);
+      Uniform &= isSimilar(get(Eval, X, Y1), Ref);
+    }
+    for (int Y = Y0; Y <= Y1; ++Y) {
+      Uniform &= isSimilar(get(Eval, X0, Y), Ref);
+      Uniform &= isSimilar(get(Eval, X1, Y), Ref);
+    }
+
+    // No interior.
+    if (X1 - X0 < 2 || Y1 - Y0 < 2)
+      return;
+
+    if (Uniform) {
+      interpolate(X0, X1, Y0, Y1);
+      return;
+    }
+
+    if (X1 - X0 <= MinSize && Y1 - Y0 <= MinSize) {
+      for (int Y = Y0 + 1; Y < Y1; ++Y)
+        for (int X = X0 + 1; X < X1; ++X)
+          get(Eval, X, Y);
+      return;
+    }
+
+    int XM = (X0 + X1) / 2;
+    int YM = (Y0 + Y1) / 2;
+    refine(Eval, X0, XM, Y0, YM);
+    refine(Eval, XM, X1, Y0, YM);
+    refine(Eval, X0, XM, YM, Y1);
+    refine(Eval, XM, X1, YM, Y1);
+  }
+
+public:
+  AdaptiveBlock(int Width, int Height):
+    Width(Width), Height(Height), Pts(Width * Height, PtColor(false, false)),
+    Known(Width * Height) {}
+
+  // Eval(X, Y) returns PtColor of point with coordinates relative to block.
+  template<typename EvalTy>
+  void render(EvalTy Eval) {
+    refine(Eval, 0, Width - 1, 0, Height - 1);
+  }
+
+  const PtColor &getPoint(int X, int Y) const {
+    return Pts[Y * Width + X];
+  }
+
+  // Number of points calculated by Eval.
+  IdxType getNumEvaluated() const {
+    return Evaluated;
+  }
+};
+
+#endif
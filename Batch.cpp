@@ -0,0 +1,77 @@
+#include "Batch.h"
+
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <cctype>
+
+static bool startsWith(const std::string &Str, const char *Prefix) {
+  return Str.compare(0, std::char_traits<char>::length(Prefix), Prefix) == 0;
+}
+
+static bool isSectionStart(const std::string &Line) {
+  return startsWith(Line, "--- EXPR ---") || startsWith(Line, "--- REJECTED ---");
+}
+
+static void stripRight(std::string &Str) {
+  while (!Str.empty() && std::isspace(static_cast<unsigned char>(Str.back())))
+    Str.pop_back();
+}
+
+// Mirrors Config#load_exprs from Scripts/config.rb.
+std::vector<ExprEntry> loadConfigExprs(const std::string &FileName) {
+  std::ifstream In(FileName);
+  if (!In)
+    throw std::runtime_error("Can't open config '" + FileName + "'");
+
+  std::string Line;
+  std::getline(In, Line);
+  stripRight(Line);
+  if (Line != "--- HEADER ---")
+    throw std::runtime_error("No header in config");
+  do {
+    if (!std::getline(In, Line))
+      throw std::runtime_error("Bad config");
+    stripRight(Line);
+  } while (Line != "--- HEADER ---");
+
+  std::vector<ExprEntry> Exprs;
+  bool HasLine = static_cast<bool>(std::getline(In, Line));
+  while (HasLine) {
+    stripRight(Line);
+    // Expression rejected by screening is kept only to reproduce generation.
+    if (Line == "--- REJECTED ---") {
+      while ((HasLine = static_cast<bool>(std::getline(In, Line))) && !isSectionStart(Line))
+        ;
+      continue;
+    }
+    if (Line != "--- EXPR ---")
+      throw std::runtime_error("Bad expression");
+
+    ExprEntry E;
+    if (!std::getline(In, Line) || !startsWith(Line, "Num: "))
+      throw std::runtime_error("Bad num parameter in expression");
+    E.Num = Line.substr(5);
+    stripRight(E.Num);
+
+    if (!std::getline(In, Line) || !startsWith(Line, "Expr: "))
+      throw std::runtime_error("Bad expr parameter in expression");
+    E.Expr = Line.substr(6);
+    while ((HasLine = static_cast<bool>(std::getline(In, Line))) &&
+           !startsWith(Line, "Diff expr: "))
+      E.Expr += "\n" + Line;
+    if (!HasLine)
+      throw std::runtime_error("Missing diff expr in expression");
+
+    E.DiffExpr = Line.substr(11);
+    while ((HasLine = static_cast<bool>(std::getline(In, Line))) && !isSectionStart(Line))
+      E.DiffExpr += "\n" + Line;
+
+    Exprs.push_back(std::move(E));
+  }
+
+  return Exprs;
+}
@@ -0,0 +1,19 @@
+#ifndef FRACGEN_BATCH_H_DEFINED__
+#define FRACGEN_BATCH_H_DEFINED__
+
+#include <string>
+#include <vector>
+
+// Expression as it is stored in config.txt by frac-gen.rb.
+struct ExprEntry {
+  std::string Num;
+  std::string Expr;
+  std::string DiffExpr;
+};
+
+// Reads all '--- EXPR ---' sections of config file. Header and
+// '--- REJECTED ---' sections are skipped.
+// Throws std::runtime_error if file is malformed.
+std::vector<ExprEntry> loadConfigExprs(const std::string &FileName);
+
+#endif
@@ -0,0 +1,373 @@
+// Benchmark of iterative methods. Every method is run over fixed set of
+// reference expressions and viewports, batchable ones also on SIMD lanes
+// of precision given by Config.h. Config.h and Norm.X.h are written by
+// Scripts/bench.rb, use 'make bench' to build and run it.
+
+#include "Color.h"
+#include "Config.h"
+#include "Lanes.hpp"
+#include "Methods.hpp"
+#include "Norm.h"
+#include "Parallel.hpp"
+#include "Support.hpp"
+#include "Types.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+namespace {
+
+// Evaluations of expression at single points by current thread.
+thread_local std::uint64_t NumEvals = 0;
+
+// Points evaluated at once: Width of ComplexLanes, 1 for ValType.
+template<typename T, typename = void>
+struct NumPoints : std::integral_constant<unsigned, 1> {};
+
+template<typename T>
+struct NumPoints<T, std::void_t<decltype(T::Width)>> :
+  std::integral_constant<unsigned, T::Width> {};
+
+// Reference expressions with derivatives. Like compiled ones they work
+// on ValType and ComplexLanes; evaluation of lanes counts every lane,
+// including masked out ones.
+
+struct Cubic {
+  static constexpr const char *Name = "z^3 - 1";
+
+  template<typename T>
+  T operator()(T Pt) const {
+    NumEvals += NumPoints<T>::value;
+    return Pt * Pt * Pt - 1.0;
+  }
+
+  template<typename T>
+  static T diff(T Pt) {
+    return 3.0 * Pt * Pt;
+  }
+};
+
+struct Quintic {
+  static constexpr const char *Name = "z^5 - 3z^2 + 1";
+
+  template<typename T>
+  T operator()(T Pt) const {
+    NumEvals += NumPoints<T>::value;
+    T Sq = Pt * Pt;
+    return Sq * Sq * Pt - 3.0 * Sq + 1.0;
+  }
+
+  template<typename T>
+  static T diff(T Pt) {
+    T Sq = Pt * Pt;
+    return 5.0 * Sq * Sq - 6.0 * Pt;
+  }
+};
+
+struct SinhCos {
+  static constexpr const char *Name = "sinh(z) * cos(z) - 1";
+
+  template<typename T>
+  T operator()(T Pt) const {
+    using std::cos;
+    using std::sinh;
+    NumEvals += NumPoints<T>::value;
+    return sinh(Pt) * cos(Pt) - 1.0;
+  }
+
+  template<typename T>
+  static T diff(T Pt) {
+    using std::cos;
+    using std::cosh;
+    using std::sin;
+    using std::sinh;
+    return cosh(Pt) * cos(Pt) - sinh(Pt) * sin(Pt);
+  }
+};
+
+struct ExpPoly {
+  static constexpr const char *Name = "exp(z) - z^2";
+
+  template<typename T>
+  T operator()(T Pt) const {
+    using std::exp;
+    NumEvals += NumPoints<T>::value;
+    return exp(Pt) - Pt * Pt;
+  }
+
+  template<typename T>
+  static T diff(T Pt) {
+    using std::exp;
+    return exp(Pt) - 2.0 * Pt;
+  }
+};
+
+struct BenchViewport {
+  const char *Name;
+  FloatType CX;
+  FloatType CY;
+  FloatType Scale;
+};
+
+// Whole picture, zoom into boundary region and very wide view.
+const BenchViewport Viewports[] = {
+  {"center", 0.0, 0.0, 100.0},
+  {"zoom", 0.5, 0.5, 2000.0},
+  {"wide", 0.0, 0.0, 10.0},
+};
+
+struct BenchOptions {
+  unsigned Threads = 1;
+  int Side = 256;
+  IterLimits Limits;
+  std::string JSONFile;
+};
+
+struct BenchResult {
+  std::string Method;
+  // Width of batch, 0 if points are iterated one by one.
+  unsigned Lanes = 0;
+  std::string Expr;
+  std::string Viewport;
+  std::uint64_t Points = 0;
+  std::uint64_t Converged = 0;
+  std::uint64_t NaNs = 0;
+  std::uint64_t Iters = 0;
+  std::uint64_t ConvergedIters = 0;
+  std::uint64_t Evals = 0;
+  double Seconds = 0.0;
+
+  double getPointsPerSec() const {
+    return Points / Seconds;
+  }
+
+  double getItersPerSec() const {
+    return Iters / Seconds;
+  }
+
+  double getAvgItersToConverge() const {
+    return Converged ? static_cast<double>(ConvergedIters) / Converged : 0.0;
+  }
+
+  double getEvalsPerIter() const {
+    return Iters ? static_cast<double>(Evals) / Iters : 0.0;
+  }
+
+  double getConvergenceRate() const {
+    return static_cast<double>(Converged) / Points;
+  }
+};
+
+// Points of row are iterated one by one by getPointIndexN or, if Lanes
+// isn't 0, Lanes at once by getPointIndexBatch as FracGen built with
+// that batch width does.
+template<typename Method, typename ExprTy, unsigned Lanes>
+BenchResult runCase(const char *MethodName, const BenchViewport &View, const BenchOptions &Opts) {
+  auto ColorFn = [Epsilon = Opts.Limits.Epsilon](ValType Pt, int Iters) {
+    return PointColor(Pt, Epsilon, Iters);
+  };
+
+  BenchResult Res;
+  Res.Method = MethodName;
+  Res.Lanes = Lanes;
+  Res.Expr = ExprTy::Name;
+  Res.Viewport = View.Name;
+  Res.Points = std::uint64_t(Opts.Side) * Opts.Side;
+
+  std::atomic<std::uint64_t> Converged(0), NaNs(0), Iters(0), ConvergedIters(0), Evals(0);
+  auto Start = std::chrono::steady_clock::now();
+  // One row per job.
+  parallelTiles(Opts.Threads, Opts.Side, [&](IdxType Row) {
+    std::uint64_t RowConverged = 0, RowNaNs = 0, RowIters = 0, RowConvergedIters = 0;
+    std::uint64_t StartEvals = NumEvals;
+    FloatType Y = static_cast<FloatType>(static_cast<int>(Row) - Opts.Side / 2) / View.Scale + View.CY;
+    auto GetX = [&View, &Opts](int i) {
+      return static_cast<FloatType>(i - Opts.Side / 2) / View.Scale + View.CX;
+    };
+    auto AddPoint = [&](const PtColor &Pt, const PointStats &Stats) {
+      RowIters += Stats.Iters;
+      RowNaNs += Stats.NaN;
+      if (Pt.first) {
+        ++RowConverged;
+        RowConvergedIters += Stats.Iters;
+      }
+    };
+    if constexpr (Lanes > 0) {
+      // Last batch of row is padded with its last point.
+      for (int i = 0; i < Opts.Side; i += Lanes) {
+        ValType Init[Lanes];
+        for (unsigned k = 0; k < Lanes; ++k)
+          Init[k] = ValType(GetX(std::min(i + static_cast<int>(k), Opts.Side - 1)), Y);
+        getPointIndexBatch<Method, Lanes>(ExprTy(), UsedNorm, ColorFn, Opts.Limits, Init,
+                                          std::min<int>(Lanes, Opts.Side - i),
+                                          [&AddPoint](unsigned, const PtColor &Pt,
+                                                      const PointStats &Stats) {
+                                            AddPoint(Pt, Stats);
+                                          });
+      }
+    } else {
+      for (int i = 0; i < Opts.Side; ++i) {
+        PointStats Stats;
+        PtColor Pt = getPointIndexN<Method>(ExprTy(), UsedNorm, ColorFn, Opts.Limits,
+                                            ValType(GetX(i), Y), getPixelSeed(0, i, Row), &Stats);
+        AddPoint(Pt, Stats);
+      }
+    }
+    Converged += RowConverged;
+    NaNs += RowNaNs;
+    Iters += RowIters;
+    ConvergedIters += RowConvergedIters;
+    Evals += NumEvals - StartEvals;
+  });
+  Res.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+  Res.Converged = Converged;
+  Res.NaNs = NaNs;
+  Res.Iters = Iters;
+  Res.ConvergedIters = ConvergedIters;
+  Res.Evals = Evals;
+  return Res;
+}
+
+template<typename Method, unsigned Lanes, typename... ExprTys>
+void runExprs(const char *MethodName, const BenchOptions &Opts, std::vector<BenchResult> &Results) {
+  for (const BenchViewport &View : Viewports) {
+    BenchResult CaseResults[] = {runCase<Method, ExprTys, Lanes>(MethodName, View, Opts)...};
+    for (BenchResult &R : CaseResults) {
+      std::string Name = R.Method;
+      if (R.Lanes)
+        Name += " x" + std::to_string(R.Lanes);
+      std::cerr << std::left << std::setw(24) << Name << std::setw(24) << R.Expr
+                << std::setw(8) << R.Viewport << std::right << std::fixed
+                << std::setprecision(0) << std::setw(12) << R.getPointsPerSec() << " pts/s"
+                << std::setw(12) << R.getItersPerSec() << " it/s"
+                << std::setprecision(2) << std::setw(6) << R.getEvalsPerIter() << " ev/it"
+                << std::setw(8) << R.getAvgItersToConverge() << " avg it"
+                << std::setw(8) << 100.0 * R.getConvergenceRate() << "% conv\n";
+      Results.push_back(std::move(R));
+    }
+  }
+}
+
+// Batchable methods are run both point by point and on lanes which fill
+// vector register.
+template<typename Method>
+void runMethod(const char *MethodName, const BenchOptions &Opts, std::vector<BenchResult> &Results) {
+  runExprs<Method, 0, Cubic, Quintic, SinhCos, ExpPoly>(MethodName, Opts, Results);
+  if constexpr (IsBatchableV<Method>)
+    runExprs<Method, DefaultLanes<IterFloatType>, Cubic, Quintic, SinhCos, ExpPoly>(MethodName,
+                                                                                  Opts, Results);
+}
+
+std::string quoteJSON(const std::string &S) {
+  std::string Res = "\"";
+  for (char C : S) {
+    if (C == '"' || C == '\\')
+      Res += '\\';
+    Res += C;
+  }
+  return Res + '"';
+}
+
+void writeJSON(std::ostream &OS, const std::vector<BenchResult> &Results,
+               const BenchOptions &Opts) {
+  OS << std::setprecision(6);
+  OS << "{\n  \"max_iters\": " << Opts.Limits.MaxIters
+     << ",\n  \"epsilon\": " << Opts.Limits.Epsilon
+     << ",\n  \"norm\": " << quoteJSON(UsedNormName)
+     << ",\n  \"precision\": " << quoteJSON(UsedPrecisionName)
+     << ",\n  \"threads\": " << Opts.Threads
+     << ",\n  \"side\": " << Opts.Side << ",\n  \"results\": [";
+  for (std::size_t i = 0; i < Results.size(); ++i) {
+    const BenchResult &R = Results[i];
+    OS << (i ? ",\n" : "\n") << "    {\"method\": " << quoteJSON(R.Method)
+       << ", \"lanes\": " << R.Lanes << ", \"expr\": " << quoteJSON(R.Expr)
+       << ", \"viewport\": " << quoteJSON(R.Viewport)
+       << ", \"points\": " << R.Points << ", \"converged\": " << R.Converged
+       << ", \"nan_exits\": " << R.NaNs << ", \"iters\": " << R.Iters
+       << ", \"fn_evals\": " << R.Evals
+       << ", \"seconds\": " << R.Seconds << ", \"points_per_sec\": " << R.getPointsPerSec()
+       << ", \"iters_per_sec\": " << R.getItersPerSec()
+       << ", \"avg_iters_to_converge\": " << R.getAvgItersToConverge()
+       << ", \"convergence_rate\": " << R.getConvergenceRate() << "}";
+  }
+  OS << "\n  ]\n}\n";
+}
+
+bool getOption(const std::string &Arg, const char *Name, std::string &Val) {
+  std::string Prefix = std::string("--") + Name + "=";
+  if (Arg.compare(0, Prefix.size(), Prefix) != 0)
+    return false;
+  Val = Arg.substr(Prefix.size());
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  BenchOptions Opts;
+  for (int i = 1; i < argc; ++i) {
+    std::string Arg = argv[i], Val;
+    if (getOption(Arg, "threads", Val)) {
+      Opts.Threads = std::strtoul(Val.c_str(), nullptr, 10);
+      if (Opts.Threads == 0)
+        Opts.Threads = getDefaultThreads();
+    } else if (getOption(Arg, "side", Val)) {
+      char *End;
+      long Side = std::strtol(Val.c_str(), &End, 10);
+      if (Val.empty() || *End || Side <= 0 || Side > 1 << 16) {
+        std::cerr << "Side should be from 1 to 65536 pixels, not '" << Val << "'\n";
+        return 1;
+      }
+      Opts.Side = Side;
+    } else if (getOption(Arg, "iters", Val)) {
+      Opts.Limits.MaxIters = std::atoi(Val.c_str());
+    } else if (getOption(Arg, "epsilon", Val)) {
+      Opts.Limits.Epsilon = std::strtod(Val.c_str(), nullptr);
+    } else if (getOption(Arg, "json", Val)) {
+      Opts.JSONFile = Val;
+    } else {
+      std::cerr << "Unknown option '" << Arg << "'\n";
+      return 1;
+    }
+  }
+
+  std::vector<BenchResult> Results;
+  runMethod<CalcNextContractor>("Contractor", Opts, Results);
+  runMethod<CalcNextInvertedContractor>("InvertedContractor", Opts, Results);
+  runMethod<CalcNextLogContractor>("LogContractor", Opts, Results);
+  runMethod<CalcNextNewton>("Newton", Opts, Results);
+  runMethod<CalcNextChord>("Chord", Opts, Results);
+  runMethod<CalcNextSteffensen>("Steffensen", Opts, Results);
+  runMethod<CalcNextSidi<7>>("Sidi<7>", Opts, Results);
+  runMethod<CalcNextSidiErroneus<7>>("SidiErroneus<7>", Opts, Results);
+  runMethod<CalcNextMuller>("Muller", Opts, Results);
+  runMethod<CalcNextMixed<CalcNextInvertedContractor, CalcNextLogContractor, CalcNextContractor>>(
+    "Mixed", Opts, Results);
+  runMethod<CalcNextMixedRandom<std::index_sequence<10, 5>, CalcNextSidi<4>, CalcNextContractor>>(
+    "MixedRandom", Opts, Results);
+
+  if (Opts.JSONFile.empty()) {
+    writeJSON(std::cout, Results, Opts);
+  } else {
+    std::ofstream Out(Opts.JSONFile);
+    writeJSON(Out, Results, Opts);
+    if (!Out) {
+      std::cerr << "Can't write " << Opts.JSONFile << '\n';
+      return 1;
+    }
+  }
+  return 0;
+}
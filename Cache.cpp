@@ -0,0 +1,171 @@
+#include "Cache.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+struct CacheHeader {
+  char Magic[8];
+  std::uint64_t KeySize;
+  DeepFloatType CX;
+  DeepFloatType CY;
+  double Scale;
+  std::uint32_t Width;
+  std::uint32_t Height;
+};
+
+constexpr char CacheMagic[8] = {'F', 'G', 'C', 'A', 'C', 'H', 'E', '2'};
+
+// Records start at multiple of 8 after header and key.
+std::size_t getRecordsOffset(std::size_t KeySize) {
+  return (sizeof(CacheHeader) + KeySize + 7) / 8 * 8;
+}
+
+// FNV-1a.
+std::uint64_t hashKey(const std::string &Key) {
+  std::uint64_t H = 0xcbf29ce484222325ULL;
+  for (unsigned char C : Key) {
+    H ^= C;
+    H *= 0x100000001b3ULL;
+  }
+  return H;
+}
+
+// Pixel of Old which is exactly at pixel Idx of New, or -1.
+// Coordinates are compared in pixels of Old, so small rounding
+// errors of scale and center don't matter. Shift is distance between
+// centers and GetNew gives offset of pixel from center of New, so
+// deep zoom views are mapped too.
+template<typename GetTy>
+std::vector<int> mapPixels(unsigned NewSize, unsigned OldSize, DeepFloatType Shift,
+                           FloatType OldScale, GetTy GetNew) {
+  constexpr FloatType Tolerance = 1e-6;
+  std::vector<int> Map(NewSize, -1);
+  for (unsigned Idx = 0; Idx < NewSize; ++Idx) {
+    FloatType Pos = static_cast<FloatType>((Shift + GetNew(Idx)) * OldScale) +
+      static_cast<int>(OldSize) / 2;
+    FloatType Nearest = std::round(Pos);
+    if (std::abs(Pos - Nearest) < Tolerance && Nearest >= 0 && Nearest < OldSize)
+      Map[Idx] = static_cast<int>(Nearest);
+  }
+  return Map;
+}
+
+} // namespace
+
+ReusedPoints::ReusedPoints(const PackedPoint *Records, const Viewport &Old,
+                           const Viewport &New):
+  Records(Records), OldWidth(Old.Width),
+  Cols(mapPixels(New.Width, Old.Width, New.CX - Old.CX, Old.Scale,
+                 [&New](unsigned Col) { return New.getOffsetX(Col); })),
+  Rows(mapPixels(New.Height, Old.Height, New.CY - Old.CY, Old.Scale,
+                 [&New](unsigned Row) { return New.getOffsetY(Row); })) {}
+
+std::uint64_t ReusedPoints::getNumCovered() const {
+  if (!Records)
+    return 0;
+  auto IsCovered = [](int Idx) { return Idx >= 0; };
+  return std::uint64_t(std::count_if(Cols.begin(), Cols.end(), IsCovered)) *
+    std::count_if(Rows.begin(), Rows.end(), IsCovered);
+}
+
+ResultCache::ResultCache(const std::string &Dir, const std::string &Key, const Viewport &View):
+  Key(Key), View(View) {
+  ::mkdir(Dir.c_str(), 0777);
+
+  char Hash[17];
+  std::snprintf(Hash, sizeof(Hash), "%016llx", static_cast<unsigned long long>(hashKey(Key)));
+  FileName = Dir + "/" + Hash + ".fgc";
+  load();
+
+  // Entry of other processes is replaced only by complete file.
+  TmpName = FileName + ".tmp" + std::to_string(::getpid());
+  Out.open(TmpName, std::ios::binary);
+  if (!Out)
+    throw std::runtime_error("Can't create cache entry " + TmpName);
+
+  CacheHeader Header;
+  std::memcpy(Header.Magic, CacheMagic, sizeof(CacheMagic));
+  Header.KeySize = Key.size();
+  Header.CX = View.CX;
+  Header.CY = View.CY;
+  Header.Scale = View.Scale;
+  Header.Width = View.Width;
+  Header.Height = View.Height;
+  Out.write(reinterpret_cast<const char *>(&Header), sizeof(Header));
+  Out.write(Key.data(), Key.size());
+  std::size_t Padding = getRecordsOffset(Key.size()) - sizeof(Header) - Key.size();
+  Out.write("\0\0\0\0\0\0\0", Padding);
+}
+
+// Missing or broken entry is just a cache miss.
+void ResultCache::load() {
+  int FD = ::open(FileName.c_str(), O_RDONLY);
+  if (FD < 0)
+    return;
+
+  struct stat St;
+  if (::fstat(FD, &St) == 0 && St.st_size >= static_cast<off_t>(sizeof(CacheHeader))) {
+    void *Ptr = ::mmap(nullptr, St.st_size, PROT_READ, MAP_PRIVATE, FD, 0);
+    if (Ptr != MAP_FAILED) {
+      Map = Ptr;
+      MapSize = St.st_size;
+    }
+  }
+  ::close(FD);
+  if (!Map)
+    return;
+
+  const auto *Bytes = static_cast<const char *>(Map);
+  CacheHeader Header;
+  std::memcpy(&Header, Bytes, sizeof(Header));
+  if (std::memcmp(Header.Magic, CacheMagic, sizeof(CacheMagic)) != 0 ||
+      Header.KeySize != Key.size() || MapSize < getRecordsOffset(Key.size()) ||
+      Key.compare(0, Key.size(), Bytes + sizeof(Header), Header.KeySize) != 0 ||
+      MapSize != getRecordsOffset(Key.size()) +
+        std::size_t(Header.Width) * Header.Height * sizeof(PackedPoint))
+    return;
+
+  Cached = ReusedPoints(
+    reinterpret_cast<const PackedPoint *>(Bytes + getRecordsOffset(Key.size())),
+    Viewport{Header.CX, Header.CY, Header.Scale, Header.Width, Header.Height}, View);
+}
+
+ResultCache::~ResultCache() {
+  if (Map)
+    ::munmap(const_cast<void *>(Map), MapSize);
+  if (Out.is_open()) {
+    Out.close();
+    std::remove(TmpName.c_str());
+  }
+}
+
+void ResultCache::append(const FractalResult &Band) {
+  std::vector<PackedPoint> Row(Band.getWidth());
+  for (unsigned j = 0; j < Band.getHeight(); ++j) {
+    for (unsigned i = 0; i < Band.getWidth(); ++i)
+      Row[i] = Band.getPacked(Band.getIndex(i, j));
+    Out.write(reinterpret_cast<const char *>(Row.data()), Row.size() * sizeof(PackedPoint));
+  }
+  RowsWritten += Band.getHeight();
+  if (!Out)
+    throw std::runtime_error("Can't write cache entry " + TmpName);
+}
+
+void ResultCache::finish() {
+  if (RowsWritten != View.Height)
+    throw std::runtime_error("Not all rows are written to cache entry " + TmpName);
+  Out.close();
+  if (!Out || std::rename(TmpName.c_str(), FileName.c_str()) != 0)
+    throw std::runtime_error("Can't write cache entry " + FileName);
+}
@@ -0,0 +1,85 @@
+#ifndef FRACGEN_CACHE_H_DEFINED__
+#define FRACGEN_CACHE_H_DEFINED__
+
+#include "Result.h"
+#include "Types.h"
+#include "Viewport.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+// Points of earlier image which are exactly at pixels of new viewport
+// (see ResultCache). Records of earlier image are not owned.
+class ReusedPoints {
+  const PackedPoint *Records = nullptr;
+  unsigned OldWidth = 0;
+  // Column (row) of earlier image for every column (row) of new one, or -1.
+  std::vector<int> Cols;
+  std::vector<int> Rows;
+
+public:
+  ReusedPoints() = default;
+  // Records are row-major points of image covering Old.
+  ReusedPoints(const PackedPoint *Records, const Viewport &Old, const Viewport &New);
+
+  // Reused point for pixel of new viewport or null.
+  const PackedPoint *lookup(int Col, int Row) const {
+    if (!Records || Cols[Col] < 0 || Rows[Row] < 0)
+      return nullptr;
+    return &Records[std::size_t(Rows[Row]) * OldWidth + Cols[Col]];
+  }
+
+  // Number of pixels of new viewport which are reused.
+  std::uint64_t getNumCovered() const;
+};
+
+// On-disk cache of packed points of the last rendered image.
+// Entry is keyed by string which describes everything that affects
+// points (expression, method, norm, epsilon, iterations, seed);
+// file name is hash of key and key itself is checked on load.
+// Previous entry is memory-mapped and every pixel of new viewport
+// that is exactly at some pixel of cached one is taken from it, so
+// recoloring doesn't calculate anything and pans calculate only new
+// pixels. New image replaces entry when it is finished.
+// Points are stored in host byte order.
+class ResultCache {
+  std::string FileName;
+  std::string Key;
+  Viewport View;
+
+  const void *Map = nullptr;
+  std::size_t MapSize = 0;
+  ReusedPoints Cached;
+
+  std::string TmpName;
+  std::ofstream Out;
+  unsigned RowsWritten = 0;
+
+  void load();
+
+public:
+  // Dir is created if it doesn't exist.
+  ResultCache(const std::string &Dir, const std::string &Key, const Viewport &View);
+  ~ResultCache();
+
+  ResultCache(const ResultCache &) = delete;
+  ResultCache &operator=(const ResultCache &) = delete;
+
+  // Points of new viewport found in cache.
+  const ReusedPoints &getReused() const {
+    return Cached;
+  }
+
+  // Appends next rows of new image. Throws std::runtime_error
+  // if entry can't be written.
+  void append(const FractalResult &Band);
+
+  // Replaces cache entry with new image after all rows are appended.
+  void finish();
+};
+
+#endif
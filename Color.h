@@ -9,40 +9,64 @@
 #include <utility>
 #include <cmath>
 
+// Only argument and norm of point are needed for color,
+// so point itself isn't kept. Norm is relative to Epsilon of
+// iterations, it is below 1 for converged points.
 class PointColor {
-  ValType CircleCoordinate;
+  FloatType Arg;
+  FloatType R;
   int Iters;
+  bool Cycled = false;
   static constexpr double pi23 = 2.094395102;
 public:
   using RGBColor = std::tuple<double, double, double>;
 
-  PointColor(ValType V, int It):
-    CircleCoordinate(V), Iters(It) {}
+  PointColor(ValType V, FloatType Epsilon, int It):
+    Arg(std::arg(V)), R(UsedNorm(V) / Epsilon), Iters(It) {}
 
-  PointColor(bool):
-    CircleCoordinate(0.0, 0.0), Iters(0) {}
+  PointColor(FloatType Arg, FloatType R, int It):
+    Arg(Arg), R(R), Iters(It) {}
+
+  // Point that hasn't converged. Cycled is set if it was stopped
+  // because it fell into cycle.
+  PointColor(bool Cycled):
+    Arg(0.0), R(0.0), Iters(0), Cycled(Cycled) {}
+
+  FloatType getArg() const {
+    return Arg;
+  }
+
+  FloatType getNorm() const {
+    return R;
+  }
+
+  int getIters() const {
+    return Iters;
+  }
+
+  bool isCycled() const {
+    return Cycled;
+  }
 
   RGBColor getRGB() const {
     RGBColor C;
-    FloatType Arg = std::arg(CircleCoordinate);
-    FloatType R = UsedNorm(CircleCoordinate);
     // Red - blue, blue - green, green - red
     if (std::cos(Arg) >= 0.5) {
       double Norm = Arg / pi23 + 1.5;
       std::get<0>(C) = Norm;
       std::get<2>(C) = 1.0 - Norm;
       // Add green color based on how far point is from center.
-      std::get<1>(C) = (Epsilon - R) / Epsilon;
+      std::get<1>(C) = 1.0 - R;
     } else if (Arg <= 0) {
       double Norm = Arg / pi23 + 0.5;
       std::get<2>(C) = Norm;
       std::get<1>(C) = 1.0 - Norm;
-      std::get<0>(C) = (Epsilon - R) / Epsilon;
+      std::get<0>(C) = 1.0 - R;
     } else {
       double Norm = Arg / pi23 - 0.5;
       std::get<1>(C) = Norm;
       std::get<0>(C) = 1.0 - Norm;
-      std::get<2>(C) = (Epsilon - R) / Epsilon;
+      std::get<2>(C) = 1.0 - R;
     }
     double Intensity = 1.0 - (std::log(static_cast<double>(Iters)) /
                               std::log(static_cast<double>(ItersLogBase)));
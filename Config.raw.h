@@ -3,17 +3,15 @@
 
 #include "Types.h"
 
-constexpr FloatType CX = <%= c_x %>;
-constexpr FloatType CY = <%= c_y %>;
+#include <type_traits>
 
-constexpr int XLen = <%= xlen %>;
-constexpr int YLen = <%= ylen %>;
+// Viewport, number of iterations and accuracy are given at runtime
+// (see RenderOptions), so they don't require recompilation.
 
-constexpr FloatType Scale = <%= scale %>;
-
-constexpr int MaxIters = <%= iters %>;
 constexpr int ItersLogBase = 1000;
 
-constexpr FloatType Epsilon = <%= epsilon %>;
+constexpr Precision UsedPrecision = Precision::<%= precision %>;
+constexpr const char *UsedPrecisionName = "<%= precision %>";
+using IterFloatType = std::conditional_t<UsedPrecision == Precision::Double, FloatType, float>;
 
 #endif
@@ -0,0 +1,161 @@
+#ifndef FRACGEN_DEEP_HPP_DEFINED__
+#define FRACGEN_DEEP_HPP_DEFINED__
+
+#include "Config.h"
+#include "Types.h"
+
+#include <complex>
+#include <vector>
+
+#include <cmath>
+
+// Deep zoom. When scale is so large that pixels are closer than
+// precision of FloatType, only orbit of center of view (reference)
+// is calculated in DeepFloatType. Every pixel keeps its offset from
+// reference in ValType and advances it by derivative of method step
+// at reference point: d(n+1) = N'(Z(n)) * d(n). Once offset has grown
+// enough to be represented in ValType next to reference point, pixel
+// is rebased to Z(n) + d(n) and iterated as usual. That works only
+// for methods which map single point to the next one (batchable ones)
+// and for holomorphic expressions (without conditionals and abs).
+
+// Complex number in DeepFloatType that expression compiled into
+// FracGen can be evaluated on. Constants of expression are converted
+// implicitly, like with ComplexLanes.
+class DeepComplex {
+public:
+  using ScalarTy = std::complex<DeepFloatType>;
+
+private:
+  ScalarTy V;
+
+public:
+  DeepComplex() = default;
+  DeepComplex(ScalarTy V): V(V) {}
+  DeepComplex(ValType V): V(V.real(), V.imag()) {}
+  DeepComplex(FloatType V): V(V) {}
+  DeepComplex(DeepFloatType Re, DeepFloatType Im): V(Re, Im) {}
+
+  const ScalarTy &get() const {
+    return V;
+  }
+
+  // Nearest ValType.
+  explicit operator ValType() const {
+    return ValType(static_cast<FloatType>(V.real()), static_cast<FloatType>(V.imag()));
+  }
+
+  bool isNaN() const {
+    return std::isnan(V.real()) || std::isnan(V.imag());
+  }
+
+  friend DeepComplex operator+(const DeepComplex &A) {
+    return A;
+  }
+
+  friend DeepComplex operator-(const DeepComplex &A) {
+    return -A.V;
+  }
+
+  friend DeepComplex operator+(const DeepComplex &A, const DeepComplex &B) {
+    return A.V + B.V;
+  }
+
+  friend DeepComplex operator-(const DeepComplex &A, const DeepComplex &B) {
+    return A.V - B.V;
+  }
+
+  friend DeepComplex operator*(const DeepComplex &A, const DeepComplex &B) {
+    return A.V * B.V;
+  }
+
+  friend DeepComplex operator/(const DeepComplex &A, const DeepComplex &B) {
+    return A.V / B.V;
+  }
+
+  friend DeepFloatType abs(const DeepComplex &Z) {
+    return std::abs(Z.V);
+  }
+
+  friend DeepComplex pow(const DeepComplex &A, const DeepComplex &B) {
+    return std::pow(A.V, B.V);
+  }
+
+#define FRACGEN_DEEP_STD_FUNC(Fn)                                       \
+  friend DeepComplex Fn(const DeepComplex &Z) {                         \
+    return std::Fn(Z.V);                                                \
+  }
+  FRACGEN_DEEP_STD_FUNC(sin)
+  FRACGEN_DEEP_STD_FUNC(cos)
+  FRACGEN_DEEP_STD_FUNC(tan)
+  FRACGEN_DEEP_STD_FUNC(asin)
+  FRACGEN_DEEP_STD_FUNC(acos)
+  FRACGEN_DEEP_STD_FUNC(atan)
+  FRACGEN_DEEP_STD_FUNC(sinh)
+  FRACGEN_DEEP_STD_FUNC(cosh)
+  FRACGEN_DEEP_STD_FUNC(tanh)
+  FRACGEN_DEEP_STD_FUNC(asinh)
+  FRACGEN_DEEP_STD_FUNC(acosh)
+  FRACGEN_DEEP_STD_FUNC(atanh)
+  FRACGEN_DEEP_STD_FUNC(exp)
+  FRACGEN_DEEP_STD_FUNC(log)
+  FRACGEN_DEEP_STD_FUNC(sqrt)
+#undef FRACGEN_DEEP_STD_FUNC
+};
+
+// Reference orbit of deep zoom. Ends after MaxIters steps or before
+// first NaN.
+class DeepOrbit {
+  // Offset is rebased when it is that large relative to point: error
+  // of linear step grows with offset, rounding of rebased point shrinks.
+  static constexpr FloatType RebaseRatio = 0x1p-26;
+  // Step of numerical derivative relative to point. Central difference
+  // in DeepFloatType is accurate to about 1e-12 with it.
+  static constexpr FloatType DiffStepRatio = 0x1p-20;
+
+  struct Step {
+    DeepComplex Pt;
+    // Derivative of method step at Pt, d(n+1) = Diff * d(n).
+    ValType Diff;
+    // Offsets larger than that are rebased.
+    FloatType Limit;
+  };
+  std::vector<Step> Steps;
+
+public:
+  DeepOrbit() = default;
+
+  // Calculates orbit of Start with function Fn that accepts DeepComplex.
+  template<typename Method, typename FnTy>
+  static DeepOrbit calculate(FnTy Fn, DeepComplex Start, int MaxIters) {
+    auto Next = [&Fn](const DeepComplex &Pt) { return Method::step(Fn, Pt, Fn(Pt)); };
+    DeepOrbit Orbit;
+    DeepComplex Pt = Start;
+    for (int i = 0; i <= MaxIters && !Pt.isNaN(); ++i) {
+      DeepFloatType R = abs(Pt);
+      DeepComplex H((R > 1 ? R : DeepFloatType(1)) * DiffStepRatio, 0);
+      DeepComplex Diff = (Next(Pt + H) - Next(Pt - H)) / (H + H);
+      Orbit.Steps.push_back({Pt, ValType(Diff), static_cast<FloatType>(R * RebaseRatio)});
+      Pt = Next(Pt);
+    }
+    return Orbit;
+  }
+
+  // Point Idx of reference shifted by Offset.
+  ValType getPoint(IdxType Idx, ValType Offset) const {
+    return ValType(Steps[Idx].Pt + DeepComplex(Offset));
+  }
+
+  // Whether point Idx with Offset can still be advanced as offset.
+  bool canFollow(IdxType Idx, ValType Offset) const {
+    return Idx + 1 < Steps.size() && !std::isnan(Offset.real()) &&
+      std::abs(Offset) <= Steps[Idx].Limit;
+  }
+
+  // Offset of point Idx + 1.
+  ValType advance(IdxType Idx, ValType Offset) const {
+    return Steps[Idx].Diff * Offset;
+  }
+};
+
+#endif
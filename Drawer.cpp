@@ -1,31 +1,250 @@
-#include "Color.h"
-#include "Config.h"
 #include "Drawer.h"
+#include "Image.h"
+#include "ImageWriter.h"
+#include "Palette.h"
+#include "Parallel.hpp"
+#include "Profile.h"
+#include "Result.h"
 
+#ifndef FRACGEN_NO_MAGICK
 #include <Magick++.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <future>
+#include <utility>
+#include <vector>
 
-#include <cstdio>
 #include <cmath>
+#include <cstdint>
+
+// Color component from [0, 1] to sample. Out of range values
+// (NaN included) are clamped.
+template<typename SampleTy>
+static SampleTy toSample(double V) {
+  constexpr SampleTy Max = RGBImage<SampleTy>::MaxSample;
+  if (!(V > 0.0))
+    return 0;
+  if (V >= 1.0)
+    return Max;
+  return static_cast<SampleTy>(std::lround(V * Max));
+}
 
-using namespace Magick;
+// Tone mapping replaces Magick++ enhance(): levels of image are
+// stretched so that ToneClip of colored pixels (by their largest
+// component) become black and ToneClip become full bright. Histogram
+// is gathered while image is colorized, then samples are mapped by
+// table in one more pass.
+constexpr unsigned HistBins = 256;
+constexpr double ToneClip = 0.005;
 
-auto drawFractal(const std::vector<PtColor> ColorIdxs) -> void {
-  Image Fractal(Geometry(XLen, YLen), "black");
-  Fractal.magick("png");
+using Histogram = std::array<std::uint64_t, HistBins>;
 
-  for (int i = 0; i < XLen; ++i)
-    for (int j = 0; j < YLen; ++j) {
-      const auto &PixelProps = ColorIdxs[i * YLen + j];
-      if (PixelProps.first) {
-        auto ColorVals = PixelProps.second.getRGB();
-        ColorRGB C("black");
-        C.red(std::get<0>(ColorVals));
-        C.green(std::get<1>(ColorVals));
-        C.blue(std::get<2>(ColorVals));
-        Fractal.pixelColor(i, j, C);
+// Table of samples for histogram Hist, empty if levels aren't changed.
+template<typename SampleTy>
+static auto getToneTable(const Histogram &Hist) -> std::vector<SampleTy> {
+  constexpr unsigned Levels = RGBImage<SampleTy>::MaxSample + 1U;
+  constexpr unsigned BinWidth = Levels / HistBins;
+  std::uint64_t Total = 0;
+  for (std::uint64_t N : Hist)
+    Total += N;
+  if (!Total)
+    return {};
+
+  auto FindBin = [&Hist](std::uint64_t Count) {
+    unsigned B = 0;
+    for (std::uint64_t Sum = Hist[0]; Sum <= Count && B + 1 < HistBins; Sum += Hist[++B])
+      ;
+    return B;
+  };
+  unsigned Low = FindBin(static_cast<std::uint64_t>(Total * ToneClip)) * BinWidth;
+  unsigned High = (FindBin(static_cast<std::uint64_t>(Total * (1.0 - ToneClip))) + 1) * BinWidth - 1;
+  if (High <= Low || (Low == 0 && High == Levels - 1))
+    return {};
+
+  std::vector<SampleTy> Table(Levels);
+  for (unsigned S = 0; S < Levels; ++S)
+    Table[S] = toSample<SampleTy>(static_cast<double>(static_cast<int>(S) - static_cast<int>(Low)) /
+                                  (High - Low));
+  return Table;
+}
+
+// Colors pixels by palette of Opts. Supersampled pixels get average
+// color of their samples. Levels are stretched if ToneMap is set.
+template<typename SampleTy>
+static auto fillImage(const FractalResult &Res, const RenderOptions &Opts,
+                      bool ToneMap) -> RGBImage<SampleTy> {
+  using RGBColor = Palette::RGBColor;
+  constexpr unsigned Levels = RGBImage<SampleTy>::MaxSample + 1U;
+  RGBImage<SampleTy> Img(Res.getWidth(), Res.getHeight());
+  const Palette &Colors = Palette::get(Opts.Colors);
+
+  // Every job converts band of rows and has its own histogram.
+  constexpr unsigned BandHeight = 16;
+  IdxType Bands = (Img.getHeight() + BandHeight - 1) / BandHeight;
+  std::vector<Histogram> Hists(ToneMap ? Bands : 0);
+  parallelTiles(Opts.Threads, Bands, [&](IdxType Band) {
+    unsigned YBegin = Band * BandHeight;
+    unsigned YEnd = std::min(YBegin + BandHeight, Img.getHeight());
+    Histogram *Hist = ToneMap ? &Hists[Band] : nullptr;
+    if (Hist)
+      Hist->fill(0);
+    for (unsigned j = YBegin; j < YEnd; ++j) {
+      SampleTy *Row = Img.getRow(j);
+      auto Sampled = Res.getSupersampled(Res.getIndex(0, j));
+      for (unsigned i = 0; i < Img.getWidth(); ++i) {
+        std::size_t Idx = Res.getIndex(i, j);
+        RGBColor ColorVals;
+        if (Sampled != Res.getSupersampledEnd() && Sampled->Idx == Idx) {
+          ColorVals = Colors.getColor(Res.getPacked(Idx));
+          for (const PackedPoint &Pt : Sampled->Samples) {
+            RGBColor C = Colors.getColor(Pt);
+            std::get<0>(ColorVals) += std::get<0>(C);
+            std::get<1>(ColorVals) += std::get<1>(C);
+            std::get<2>(ColorVals) += std::get<2>(C);
+          }
+          double N = Sampled->Samples.size() + 1;
+          ColorVals = RGBColor(std::get<0>(ColorVals) / N, std::get<1>(ColorVals) / N,
+                               std::get<2>(ColorVals) / N);
+          ++Sampled;
+        } else if (Res.isConverged(Idx) || Res.isCycled(Idx)) {
+          ColorVals = Colors.getColor(Res.getPacked(Idx));
+        } else {
+          continue;
+        }
+        SampleTy *Px = Row + 3 * i;
+        Px[0] = toSample<SampleTy>(std::get<0>(ColorVals));
+        Px[1] = toSample<SampleTy>(std::get<1>(ColorVals));
+        Px[2] = toSample<SampleTy>(std::get<2>(ColorVals));
+        SampleTy Max = std::max({Px[0], Px[1], Px[2]});
+        if (Hist && Max)
+          ++(*Hist)[Max / (Levels / HistBins)];
       }
     }
+  });
+
+  if (!ToneMap)
+    return Img;
+  Histogram Hist{};
+  for (const Histogram &H : Hists)
+    for (unsigned B = 0; B < HistBins; ++B)
+      Hist[B] += H[B];
+  std::vector<SampleTy> Table = getToneTable<SampleTy>(Hist);
+  if (Table.empty())
+    return Img;
+  parallelTiles(Opts.Threads, Bands, [&Img, &Table](IdxType Band) {
+    unsigned YBegin = Band * BandHeight;
+    unsigned YEnd = std::min(YBegin + BandHeight, Img.getHeight());
+    for (unsigned j = YBegin; j < YEnd; ++j) {
+      SampleTy *Row = Img.getRow(j);
+      for (unsigned i = 0; i < 3 * Img.getWidth(); ++i)
+        Row[i] = Table[Row[i]];
+    }
+  });
+  return Img;
+}
+
+#ifndef FRACGEN_NO_MAGICK
+// Whole buffer is imported by Magick++ at once.
+template<typename SampleTy>
+static void writeWithMagick(const RGBImage<SampleTy> &Img, const std::string &FileName) {
+  Magick::Image Fractal;
+  Fractal.read(Img.getWidth(), Img.getHeight(), "RGB",
+               sizeof(SampleTy) == 1 ? Magick::CharPixel : Magick::ShortPixel, Img.getData());
+  Fractal.magick("png");
+  Fractal.depth(Img.Depth);
+  Fractal.write(FileName);
+}
+#endif
+
+template<typename SampleTy>
+static void drawImage(const FractalResult &Res, const std::string &FileName,
+                      const RenderOptions &Opts, RenderProfile *Profile) {
+  using Phase = RenderProfile::Phase;
+  RGBImage<SampleTy> Img = timePhase(Profile, Phase::Colorize, [&Res, &Opts] {
+      return fillImage<SampleTy>(Res, Opts, Opts.ToneMap);
+    });
+  timePhase(Profile, Phase::Encode, [&Img, &FileName, &Opts] {
+#ifndef FRACGEN_NO_MAGICK
+      if (!Opts.BuiltinWriter && ImageWriter::getFormat(FileName) == ImageWriter::Format::PNG) {
+        writeWithMagick(Img, FileName);
+        return;
+      }
+#endif
+      writeImage(Img, FileName);
+    });
+}
+
+auto drawFractal(const FractalResult &Res, const std::string &FileName,
+                 const RenderOptions &Opts, RenderProfile *Profile) -> void {
+  if (Opts.Depth == 16)
+    drawImage<std::uint16_t>(Res, FileName, Opts, Profile);
+  else
+    drawImage<std::uint8_t>(Res, FileName, Opts, Profile);
+}
+
+template<typename SampleTy>
+static void drawFrameImage(const FractalResult &Res, std::ostream &Video, const std::string &Name,
+                           const RenderOptions &Opts, RenderProfile *Profile) {
+  using Phase = RenderProfile::Phase;
+  RGBImage<SampleTy> Img = timePhase(Profile, Phase::Colorize, [&Res, &Opts] {
+      return fillImage<SampleTy>(Res, Opts, Opts.ToneMap);
+    });
+  timePhase(Profile, Phase::Encode, [&] {
+      ImageWriter Writer(Video, Name, ImageWriter::Format::PPM, Img.getWidth(), Img.getHeight(),
+                         Img.Depth);
+      for (unsigned Y = 0; Y < Img.getHeight(); ++Y)
+        Writer.writeRow(Img.getRow(Y));
+      Writer.finish();
+    });
+}
+
+auto drawFrame(const FractalResult &Res, std::ostream &Video, const std::string &Name,
+               const RenderOptions &Opts, RenderProfile *Profile) -> void {
+  if (Opts.Depth == 16)
+    drawFrameImage<std::uint16_t>(Res, Video, Name, Opts, Profile);
+  else
+    drawFrameImage<std::uint8_t>(Res, Video, Name, Opts, Profile);
+}
+
+// Encoding of bands overlaps rendering, so its time is the sum of
+// writing times of all bands.
+template<typename SampleTy>
+static void drawBands(const std::function<FractalResult(int, int)> &GetBand,
+                      const std::string &FileName, const RenderOptions &Opts,
+                      RenderProfile *Profile) {
+  using Phase = RenderProfile::Phase;
+  const Viewport &View = Opts.View;
+  ImageWriter Writer(FileName, View.Width, View.Height, RGBImage<SampleTy>::Depth);
+  std::future<void> Written;
+  for (unsigned Begin = 0; Begin < View.Height; Begin += Opts.BandHeight) {
+    unsigned End = std::min(Begin + Opts.BandHeight, View.Height);
+    FractalResult Band = GetBand(Begin, End);
+    // Levels of the whole image aren't known until the last band.
+    RGBImage<SampleTy> Img = timePhase(Profile, Phase::Colorize, [&Band, &Opts] {
+        return fillImage<SampleTy>(Band, Opts, false);
+      });
+    if (Written.valid())
+      Written.get();
+    Written = std::async(std::launch::async, [&Writer, Profile, Img = std::move(Img)] {
+        timePhase(Profile, Phase::Encode, [&Writer, &Img] {
+            for (unsigned j = 0; j < Img.getHeight(); ++j)
+              Writer.writeRow(Img.getRow(j));
+          });
+      });
+  }
+  if (Written.valid())
+    Written.get();
+  timePhase(Profile, Phase::Encode, [&Writer] { Writer.finish(); });
+}
 
-  Fractal.enhance();
-  Fractal.write("FractalImage.png");
+auto drawFractalByBands(const std::function<FractalResult(int, int)> &GetBand,
+                        const std::string &FileName, const RenderOptions &Opts,
+                        RenderProfile *Profile) -> void {
+  if (Opts.Depth == 16)
+    drawBands<std::uint16_t>(GetBand, FileName, Opts, Profile);
+  else
+    drawBands<std::uint8_t>(GetBand, FileName, Opts, Profile);
 }
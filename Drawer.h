@@ -1,11 +1,34 @@
 #ifndef FRACTAL_DRAWER_H
 #define FRACTAL_DRAWER_H
 
-#include <utility>
-#include <vector>
+#include <functional>
+#include <ostream>
+#include <string>
 
-#include "Color.h"
+#include "Options.h"
+#include "Profile.h"
+#include "Result.h"
 
-void drawFractal(const std::vector<PtColor> ColorIdx);
+// Writes image with Magick++ or, if FracGen is built without it
+// or asked so by options, with built-in PNG/PPM writer. Points are
+// colored by palette of options and levels of image are stretched by
+// its histogram unless options disable it (see Drawer.cpp).
+// Times of colorization and encoding are added to Profile if it is given.
+void drawFractal(const FractalResult &Res, const std::string &FileName,
+                 const RenderOptions &Opts, RenderProfile *Profile = nullptr);
+
+// Appends image to Video as binary PPM, so stream of frames can be
+// piped to video encoder (e.g. ffmpeg -f image2pipe -c:v ppm -i -).
+// Name of stream is used in error messages.
+void drawFrame(const FractalResult &Res, std::ostream &Video, const std::string &Name,
+               const RenderOptions &Opts, RenderProfile *Profile = nullptr);
+
+// Renders image by bands of Opts.BandHeight rows. GetBand(Begin, End)
+// should return result for rows [Begin, End). Every band is written
+// with built-in writer while the next one is rendered, then freed,
+// so only two bands are kept in memory.
+void drawFractalByBands(const std::function<FractalResult(int, int)> &GetBand,
+                        const std::string &FileName, const RenderOptions &Opts,
+                        RenderProfile *Profile = nullptr);
 
 #endif
@@ -0,0 +1,441 @@
+#include "Expr.h"
+
+#include <algorithm>
+#include <complex>
+#include <map>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+using OpCode = ExprProgram::OpCode;
+
+static bool isTrue(ValType V) {
+  return V.real() != 0.0 || V.imag() != 0.0;
+}
+
+static ValType fromBool(bool B) {
+  return B ? 1.0 : 0.0;
+}
+
+// Semantics of every instruction. Shared between interpreter and
+// constant folding so folded expressions give exactly the same values.
+static inline ValType applyOp(OpCode Op, ValType A, ValType B, ValType C) {
+  switch (Op) {
+#define FRACGEN_EXPR_FUNC_CASE(Op, Fn)                         \
+  case OpCode::Op: return std::Fn(A);                          \
+  case OpCode::Op##R: return std::Fn(A.real());
+    FRACGEN_EXPR_FUNCS(FRACGEN_EXPR_FUNC_CASE)
+#undef FRACGEN_EXPR_FUNC_CASE
+  case OpCode::Pow: return std::pow(A, B);
+  case OpCode::PowR: return std::pow(A.real(), B.real());
+  case OpCode::Add: return A + B;
+  case OpCode::Sub: return A - B;
+  case OpCode::Mul: return A * B;
+  case OpCode::Div: return A / B;
+  case OpCode::DivR: return A.real() / B.real();
+  case OpCode::Neg: return -A;
+  case OpCode::Abs: return std::abs(A);
+  case OpCode::Lt: return fromBool(A.real() < B.real());
+  case OpCode::Gt: return fromBool(A.real() > B.real());
+  case OpCode::Le: return fromBool(A.real() <= B.real());
+  case OpCode::Ge: return fromBool(A.real() >= B.real());
+  case OpCode::Eq: return fromBool(A == B);
+  case OpCode::Ne: return fromBool(A != B);
+  case OpCode::And: return fromBool(isTrue(A) && isTrue(B));
+  case OpCode::Or: return fromBool(isTrue(A) || isTrue(B));
+  case OpCode::Not: return fromBool(!isTrue(A));
+  case OpCode::Select: return isTrue(A) ? B : C;
+  }
+  return 0.0;
+}
+
+static unsigned getArity(OpCode Op) {
+  switch (Op) {
+  case OpCode::Pow: case OpCode::PowR:
+  case OpCode::Add: case OpCode::Sub: case OpCode::Mul:
+  case OpCode::Div: case OpCode::DivR:
+  case OpCode::Lt: case OpCode::Gt: case OpCode::Le:
+  case OpCode::Ge: case OpCode::Eq: case OpCode::Ne:
+  case OpCode::And: case OpCode::Or:
+    return 2;
+  case OpCode::Select:
+    return 3;
+  default:
+    return 1;
+  }
+}
+
+namespace {
+
+// Type of C++ expression frac-gen.rb generates. Real values
+// (e.g. results of std::abs) follow real arithmetic.
+enum class Kind { Bool, Real, Complex };
+
+struct Node {
+  enum { Arg, Const, Op } Type;
+  Kind K;
+  OpCode Code;
+  IdxType A, B, C;
+  ValType Value;
+};
+
+// Builds expression DAG. Every node is created only once
+// and nodes with constant operands are folded.
+class DagBuilder {
+  std::vector<Node> Nodes;
+  std::map<std::tuple<OpCode, IdxType, IdxType, IdxType>, IdxType> OpNodes;
+  // Constants are compared bitwise: -0.0 is not 0.0 and NaN is fine.
+  using ConstKey = std::tuple<Kind, std::uint64_t, std::uint64_t>;
+  std::map<ConstKey, IdxType> Consts;
+
+  static std::uint64_t getBits(FloatType V) {
+    static_assert(sizeof(FloatType) == sizeof(std::uint64_t), "Unexpected float size");
+    std::uint64_t Bits;
+    std::memcpy(&Bits, &V, sizeof(Bits));
+    return Bits;
+  }
+
+public:
+  DagBuilder() {
+    Nodes.push_back({Node::Arg, Kind::Complex, OpCode::Add, 0, 0, 0, 0.0});
+  }
+
+  const Node &operator[](IdxType Idx) const {
+    return Nodes[Idx];
+  }
+
+  IdxType size() const {
+    return Nodes.size();
+  }
+
+  IdxType getConst(ValType V, Kind K) {
+    auto Res = Consts.emplace(ConstKey(K, getBits(V.real()), getBits(V.imag())), Nodes.size());
+    if (Res.second)
+      Nodes.push_back({Node::Const, K, OpCode::Add, 0, 0, 0, V});
+    return Res.first->second;
+  }
+
+  IdxType getOp(OpCode Code, Kind K, IdxType A, IdxType B = 0, IdxType C = 0) {
+    unsigned Arity = getArity(Code);
+    const Node &NA = Nodes[A], &NB = Nodes[B], &NC = Nodes[C];
+    if (NA.Type == Node::Const &&
+        (NB.Type == Node::Const || Arity < 2) &&
+        (NC.Type == Node::Const || Arity < 3))
+      return getConst(applyOp(Code, NA.Value, NB.Value, NC.Value), K);
+
+    auto Res = OpNodes.emplace(std::make_tuple(Code, A, B, C), Nodes.size());
+    if (Res.second)
+      Nodes.push_back({Node::Op, K, Code, A, B, C, 0.0});
+    return Res.first->second;
+  }
+};
+
+class Parser {
+  const char *Cur;
+  DagBuilder &Dag;
+
+  [[noreturn]] void error(const std::string &Msg) {
+    throw ExprError(Msg + " at '" + std::string(Cur).substr(0, 20) + "'");
+  }
+
+  void skipSpaces() {
+    while (std::isspace(static_cast<unsigned char>(*Cur)))
+      ++Cur;
+  }
+
+  bool consume(const char *Tok) {
+    skipSpaces();
+    size_t Len = std::strlen(Tok);
+    if (std::strncmp(Cur, Tok, Len) != 0)
+      return false;
+    Cur += Len;
+    return true;
+  }
+
+  void expect(const char *Tok) {
+    if (!consume(Tok))
+      error(std::string("Expected '") + Tok + "'");
+  }
+
+  std::string parseIdent() {
+    skipSpaces();
+    std::string Id;
+    while (std::isalnum(static_cast<unsigned char>(*Cur)) || *Cur == '_' ||
+           (Cur[0] == ':' && Cur[1] == ':')) {
+      if (*Cur == ':') {
+        Id += "::";
+        Cur += 2;
+      } else {
+        Id += *Cur++;
+      }
+    }
+    return Id;
+  }
+
+  Kind getKind(IdxType Idx) const {
+    return Dag[Idx].K;
+  }
+
+  IdxType getArith(OpCode Code, IdxType A, IdxType B) {
+    bool Real = getKind(A) != Kind::Complex && getKind(B) != Kind::Complex;
+    if (Real && Code == OpCode::Div)
+      Code = OpCode::DivR;
+    return Dag.getOp(Code, Real ? Kind::Real : Kind::Complex, A, B);
+  }
+
+  IdxType parseCall(const std::string &Name) {
+    std::vector<IdxType> Args;
+    if (!consume(")")) {
+      do
+        Args.push_back(parseTernary());
+      while (consume(","));
+      expect(")");
+    }
+
+    auto checkArgs = [this, &Name, &Args](size_t Num) {
+      if (Args.size() != Num)
+        error("Wrong number of arguments of '" + Name + "'");
+    };
+
+    if (Name == "ValType") {
+      if (Args.empty() || Args.size() > 2)
+        error("Wrong number of arguments of 'ValType'");
+      IdxType Re = Args[0];
+      if (Args.size() == 1)
+        return Dag.getOp(OpCode::Add, Kind::Complex, Re, Dag.getConst(0.0, Kind::Complex));
+      IdxType Im = Dag.getOp(OpCode::Mul, Kind::Complex, Args[1],
+                             Dag.getConst(ValType(0.0, 1.0), Kind::Complex));
+      return Dag.getOp(OpCode::Add, Kind::Complex, Re, Im);
+    }
+
+    if (Name == "abs" || Name == "fabs") {
+      checkArgs(1);
+      return Dag.getOp(OpCode::Abs, Kind::Real, Args[0]);
+    }
+
+    if (Name == "pow") {
+      checkArgs(2);
+      bool Real = getKind(Args[0]) != Kind::Complex && getKind(Args[1]) != Kind::Complex;
+      return Dag.getOp(Real ? OpCode::PowR : OpCode::Pow,
+                       Real ? Kind::Real : Kind::Complex, Args[0], Args[1]);
+    }
+
+#define FRACGEN_EXPR_FUNC_NAME(Op, Fn)                                  \
+    if (Name == #Fn) {                                                  \
+      checkArgs(1);                                                     \
+      if (getKind(Args[0]) == Kind::Complex)                            \
+        return Dag.getOp(OpCode::Op, Kind::Complex, Args[0]);           \
+      return Dag.getOp(OpCode::Op##R, Kind::Real, Args[0]);             \
+    }
+    FRACGEN_EXPR_FUNCS(FRACGEN_EXPR_FUNC_NAME)
+#undef FRACGEN_EXPR_FUNC_NAME
+
+    error("Unknown function '" + Name + "'");
+  }
+
+  IdxType parsePrimary() {
+    skipSpaces();
+    if (consume("(")) {
+      IdxType Res = parseTernary();
+      expect(")");
+      return Res;
+    }
+
+    if (std::isdigit(static_cast<unsigned char>(*Cur)) ||
+        (*Cur == '.' && std::isdigit(static_cast<unsigned char>(Cur[1])))) {
+      char *End;
+      FloatType Val = std::strtod(Cur, &End);
+      Cur = End;
+      return Dag.getConst(Val, Kind::Real);
+    }
+
+    std::string Name = parseIdent();
+    if (Name.empty())
+      error("Expected expression");
+    if (Name.compare(0, 5, "std::") == 0)
+      Name.erase(0, 5);
+
+    if (Name == "Pt")
+      return 0;
+
+    if (!consume("("))
+      error("Unknown variable '" + Name + "'");
+    return parseCall(Name);
+  }
+
+  IdxType parseUnary() {
+    if (consume("-")) {
+      IdxType Op = parseUnary();
+      Kind K = getKind(Op) == Kind::Complex ? Kind::Complex : Kind::Real;
+      return Dag.getOp(OpCode::Neg, K, Op);
+    }
+    if (consume("+"))
+      return parseUnary();
+    if (consume("!"))
+      return Dag.getOp(OpCode::Not, Kind::Bool, parseUnary());
+    return parsePrimary();
+  }
+
+  IdxType parseMul() {
+    IdxType Res = parseUnary();
+    for (;;) {
+      if (consume("*"))
+        Res = getArith(OpCode::Mul, Res, parseUnary());
+      else if (consume("/"))
+        Res = getArith(OpCode::Div, Res, parseUnary());
+      else
+        return Res;
+    }
+  }
+
+  IdxType parseAdd() {
+    IdxType Res = parseMul();
+    for (;;) {
+      if (consume("+"))
+        Res = getArith(OpCode::Add, Res, parseMul());
+      else if (consume("-"))
+        Res = getArith(OpCode::Sub, Res, parseMul());
+      else
+        return Res;
+    }
+  }
+
+  IdxType parseRel() {
+    IdxType Res = parseAdd();
+    for (;;) {
+      OpCode Code;
+      if (consume("<="))
+        Code = OpCode::Le;
+      else if (consume(">="))
+        Code = OpCode::Ge;
+      else if (consume("<"))
+        Code = OpCode::Lt;
+      else if (consume(">"))
+        Code = OpCode::Gt;
+      else
+        return Res;
+      Res = Dag.getOp(Code, Kind::Bool, Res, parseAdd());
+    }
+  }
+
+  IdxType parseEq() {
+    IdxType Res = parseRel();
+    for (;;) {
+      if (consume("=="))
+        Res = Dag.getOp(OpCode::Eq, Kind::Bool, Res, parseRel());
+      else if (consume("!="))
+        Res = Dag.getOp(OpCode::Ne, Kind::Bool, Res, parseRel());
+      else
+        return Res;
+    }
+  }
+
+  IdxType parseAnd() {
+    IdxType Res = parseEq();
+    while (consume("&&"))
+      Res = Dag.getOp(OpCode::And, Kind::Bool, Res, parseEq());
+    return Res;
+  }
+
+  IdxType parseOr() {
+    IdxType Res = parseAnd();
+    while (consume("||"))
+      Res = Dag.getOp(OpCode::Or, Kind::Bool, Res, parseAnd());
+    return Res;
+  }
+
+  IdxType parseTernary() {
+    IdxType Cond = parseOr();
+    if (!consume("?"))
+      return Cond;
+    IdxType Then = parseTernary();
+    expect(":");
+    IdxType Else = parseTernary();
+    Kind K = getKind(Then) == Kind::Complex || getKind(Else) == Kind::Complex ?
+      Kind::Complex : Kind::Real;
+    return Dag.getOp(OpCode::Select, K, Cond, Then, Else);
+  }
+
+public:
+  Parser(const std::string &Src, DagBuilder &Dag): Cur(Src.c_str()), Dag(Dag) {}
+
+  // Returns false if body is abort().
+  bool parseBody(IdxType &Res) {
+    skipSpaces();
+    const char *Start = Cur;
+    std::string Id = parseIdent();
+    if (Id == "abort" || Id == "std::abort")
+      return false;
+    if (Id != "return")
+      Cur = Start;
+
+    Res = parseTernary();
+    consume(";");
+    skipSpaces();
+    if (*Cur)
+      error("Unexpected symbols");
+    return true;
+  }
+};
+
+} // namespace
+
+ExprProgram ExprProgram::compile(const std::string &Src) {
+  DagBuilder Dag;
+  IdxType Root;
+  ExprProgram Prog;
+  if (!Parser(Src, Dag).parseBody(Root))
+    return Prog;
+
+  // Drop nodes that are left after folding.
+  std::vector<bool> Used(Dag.size(), false);
+  Used[Root] = true;
+  for (IdxType i = Dag.size(); i-- > 0;) {
+    const Node &N = Dag[i];
+    if (!Used[i] || N.Type != Node::Op)
+      continue;
+    Used[N.A] = Used[N.B] = Used[N.C] = true;
+  }
+
+  // Argument, constants and instructions keep relative order,
+  // so operands are always evaluated before their users.
+  std::vector<IdxType> Reg(Dag.size(), 0);
+  for (IdxType i = 1; i < Dag.size(); ++i)
+    if (Used[i] && Dag[i].Type == Node::Const) {
+      Reg[i] = 1 + Prog.Consts.size();
+      Prog.Consts.push_back(Dag[i].Value);
+    }
+
+  for (IdxType i = 1; i < Dag.size(); ++i)
+    if (Used[i] && Dag[i].Type == Node::Op) {
+      const Node &N = Dag[i];
+      Reg[i] = 1 + Prog.Consts.size() + Prog.Code.size();
+      Prog.Code.push_back({N.Code, Reg[N.A], Reg[N.B], Reg[N.C]});
+    }
+
+  Prog.Result = Reg[Root];
+  Prog.Defined = true;
+  return Prog;
+}
+
+void ExprProgram::initRegs(ValType *Regs) const {
+  std::copy(Consts.begin(), Consts.end(), Regs + 1);
+}
+
+ValType ExprProgram::eval(ValType Pt, ValType *Regs) const {
+  if (!Defined)
+    throw ExprError("Expression is not defined");
+
+  Regs[0] = Pt;
+  ValType *Out = Regs + 1 + Consts.size();
+  for (const Instr &I : Code)
+    *Out++ = applyOp(I.Op, Regs[I.A], Regs[I.B], Regs[I.C]);
+  return Regs[Result];
+}
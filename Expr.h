@@ -0,0 +1,127 @@
+#ifndef FRACGEN_EXPR_H_DEFINED__
+#define FRACGEN_EXPR_H_DEFINED__
+
+#include "Types.h"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <cstdint>
+
+// Functions of one argument known to expression compiler.
+// Every function has complex and real (suffixed with R) instruction.
+#define FRACGEN_EXPR_FUNCS(X)                   \
+  X(Sin, sin) X(Cos, cos) X(Tan, tan)           \
+  X(Asin, asin) X(Acos, acos) X(Atan, atan)     \
+  X(Sinh, sinh) X(Cosh, cosh) X(Tanh, tanh)     \
+  X(Asinh, asinh) X(Acosh, acosh) X(Atanh, atanh) \
+  X(Exp, exp) X(Log, log) X(Sqrt, sqrt)
+
+class ExprError : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+// Expression compiled at runtime into flat list of instructions.
+// Register 0 holds argument, then constants follow, then every
+// instruction writes its own register. Equal subexpressions share
+// one register and constant subexpressions are folded by compiler.
+class ExprProgram {
+public:
+  enum class OpCode : std::uint8_t {
+#define FRACGEN_EXPR_FUNC_OP(Op, Fn) Op, Op##R,
+    FRACGEN_EXPR_FUNCS(FRACGEN_EXPR_FUNC_OP)
+#undef FRACGEN_EXPR_FUNC_OP
+    Pow, PowR,
+    Add, Sub, Mul, Div, DivR, Neg,
+    Abs,
+    Lt, Gt, Le, Ge, Eq, Ne,
+    And, Or, Not,
+    Select
+  };
+
+  struct Instr {
+    OpCode Op;
+    IdxType A;
+    IdxType B;
+    IdxType C;
+  };
+
+private:
+  std::vector<ValType> Consts;
+  std::vector<Instr> Code;
+  IdxType Result = 0;
+  bool Defined = false;
+
+public:
+  // Empty program. Like expression with abort() it isn't defined:
+  // eval() throws ExprError.
+  ExprProgram() = default;
+
+  // Accepts what frac-gen.rb puts into Fn body: 'return <expr>;'
+  // or 'abort(); ...' for missing expression. Bare expression is fine too.
+  // Throws ExprError on bad input.
+  static ExprProgram compile(const std::string &Src);
+
+  bool isDefined() const {
+    return Defined;
+  }
+
+  IdxType getNumRegs() const {
+    return 1 + Consts.size() + Code.size();
+  }
+
+  IdxType getNumInstrs() const {
+    return Code.size();
+  }
+
+  // Registers should be initialized once before evaluations.
+  void initRegs(ValType *Regs) const;
+
+  ValType eval(ValType Pt, ValType *Regs) const;
+};
+
+// Function object for iterative methods. Evaluates expression
+// and its derivative in registers owned by ExprContext.
+class ExprFunc {
+  const ExprProgram *Fn;
+  const ExprProgram *Diff;
+  ValType *FnRegs;
+  ValType *DiffRegs;
+
+public:
+  ExprFunc(const ExprProgram &Fn, const ExprProgram &Diff,
+           ValType *FnRegs, ValType *DiffRegs):
+    Fn(&Fn), Diff(&Diff), FnRegs(FnRegs), DiffRegs(DiffRegs) {}
+
+  ValType operator()(ValType Pt) const {
+    return Fn->eval(Pt, FnRegs);
+  }
+
+  ValType diff(ValType Pt) const {
+    return Diff->eval(Pt, DiffRegs);
+  }
+};
+
+// Registers for evaluation of expression and its derivative.
+// Every thread needs its own context.
+class ExprContext {
+  const ExprProgram &Fn;
+  const ExprProgram &Diff;
+  std::vector<ValType> FnRegs;
+  std::vector<ValType> DiffRegs;
+
+public:
+  ExprContext(const ExprProgram &Fn, const ExprProgram &Diff):
+    Fn(Fn), Diff(Diff), FnRegs(Fn.getNumRegs()), DiffRegs(Diff.getNumRegs()) {
+    Fn.initRegs(FnRegs.data());
+    Diff.initRegs(DiffRegs.data());
+  }
+
+  ExprFunc getFunc() {
+    return ExprFunc(Fn, Diff, FnRegs.data(), DiffRegs.data());
+  }
+};
+
+#endif
@@ -1,11 +1,517 @@
+#include "Batch.h"
+#include "Cache.h"
 #include "Drawer.h"
+#include "Expr.h"
+#include "Module.h"
+#include "Options.h"
+#include "Palette.h"
+#include "Profile.h"
+#include "Result.h"
+#include "Screen.h"
 #include "Types.h"
 
+#include <exception>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
 #include <vector>
 
-std::vector<PtColor> getFractal();
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
 
-int main(int argc, char** argv) {
-  drawFractal(getFractal());
+FractalResult getFractal(const ExprProgram &Fn, const ExprProgram &Diff, const RenderOptions &Opts,
+                         int RowBegin, int RowEnd, const ReusedPoints *Reused,
+                         RenderProfile *Profile);
+ScreenResult screenFractal(const ExprProgram &Fn, const ExprProgram &Diff,
+                           const RenderOptions &Opts);
+bool methodUsesDiff();
+std::string getResultKey(const std::string &Expr, const std::string &DiffExpr,
+                         const RenderOptions &Opts);
+
+static bool getOption(const std::string &Arg, const char *Name, std::string &Val) {
+  std::string Prefix = std::string("--") + Name + "=";
+  if (Arg.compare(0, Prefix.size(), Prefix) != 0)
+    return false;
+  Val = Arg.substr(Prefix.size());
+  return true;
+}
+
+// Exit code of --screen for rejected expression.
+constexpr int ScreenRejected = 3;
+
+// Prints probe to stdout and returns exit code.
+static int reportScreen(const ScreenResult &Res, const ScreenThresholds &Thresholds) {
+  std::cout << "converged " << Res.Converged << ", entropy " << Res.Entropy << " bits\n";
+  return Thresholds.accepts(Res) ? 0 : ScreenRejected;
+}
+
+static std::unique_ptr<RenderProfile> makeProfile(const RenderOptions &Opts) {
+  if (!Opts.Profile && !Opts.Heatmap)
+    return nullptr;
+  return std::make_unique<RenderProfile>(Opts.View.Width, Opts.View.Height,
+                                         Opts.Limits.MaxIters);
+}
+
+// Image.png, -cost -> Image-cost.png.
+static std::string addSuffix(const std::string &FileName, const std::string &Suffix) {
+  std::string::size_type Dot = FileName.rfind('.');
+  std::string::size_type Slash = FileName.rfind('/');
+  if (Dot == std::string::npos || (Slash != std::string::npos && Dot < Slash))
+    return FileName + Suffix;
+  return FileName.substr(0, Dot) + Suffix + FileName.substr(Dot);
+}
+
+static std::string getHeatmapName(const std::string &FileName) {
+  return addSuffix(FileName, "-cost");
+}
+
+// Prints profile report and writes heatmap if they are asked by options.
+static void reportProfile(const std::string &FileName, const RenderOptions &Opts,
+                          const RenderProfile *Profile) {
+  if (Opts.Profile) {
+    // Report is printed at once as other image may be rendered meanwhile.
+    std::ostringstream Report;
+    Report << "Profile of " << FileName << ":\n";
+    Profile->printReport(Report);
+    std::cerr << Report.str();
+  }
+  if (Opts.Heatmap)
+    Profile->writeHeatmap(getHeatmapName(FileName));
+}
+
+// Renders image with rows given by GetBand(Opts, Begin, End, Reused, Profile)
+// either at once or band by band. If cache directory is given, points
+// are looked up in cache entry for Key and new image replaces it.
+// Profile is null if it isn't asked by options.
+// If Pending is given, whole image is written by background task
+// stored there, so caller can render next image meanwhile. Task of
+// previous image is waited for first. If it failed, its exception is
+// rethrown after this image is passed to its own task.
+template<typename GetBandTy>
+static void renderImage(GetBandTy GetBand, const std::string &Key, const std::string &FileName,
+                        const RenderOptions &Opts, std::unique_ptr<RenderProfile> Profile,
+                        std::future<void> *Pending = nullptr) {
+  std::unique_ptr<ResultCache> Cache;
+  if (!Opts.CacheDir.empty()) {
+    timePhase(Profile.get(), RenderProfile::Phase::Setup, [&] {
+        Cache = std::make_unique<ResultCache>(Opts.CacheDir, Key, Opts.View);
+      });
+    std::cerr << Cache->getReused().getNumCovered() << " of "
+              << std::uint64_t(Opts.View.Width) * Opts.View.Height
+              << " points are taken from cache\n";
+  }
+
+  auto GetCachedBand = [&GetBand, &Opts, &Cache, &Profile](int Begin, int End) {
+    FractalResult Res = GetBand(Opts, Begin, End, Cache ? &Cache->getReused() : nullptr,
+                                Profile.get());
+    if (Cache)
+      Cache->append(Res);
+    return Res;
+  };
+
+  // Bands are already written while next ones are rendered.
+  if (Opts.BandHeight) {
+    drawFractalByBands(GetCachedBand, FileName, Opts, Profile.get());
+    if (Cache)
+      Cache->finish();
+    reportProfile(FileName, Opts, Profile.get());
+    return;
+  }
+
+  FractalResult Res = GetCachedBand(0, Opts.View.Height);
+  if (Cache)
+    Cache->finish();
+
+  auto Draw = [Res = std::move(Res), FileName, Opts, Profile = std::move(Profile)] {
+    drawFractal(Res, FileName, Opts, Profile.get());
+    reportProfile(FileName, Opts, Profile.get());
+  };
+  if (!Pending) {
+    Draw();
+    return;
+  }
+  std::exception_ptr PrevError;
+  if (Pending->valid()) {
+    try {
+      Pending->get();
+    } catch (...) {
+      PrevError = std::current_exception();
+    }
+  }
+  *Pending = std::async(std::launch::async, std::move(Draw));
+  if (PrevError)
+    std::rethrow_exception(PrevError);
+}
+
+// Zoom or pan from viewport of render options to End. Scale changes
+// geometrically, center moves in proportion to width of view, so
+// zoom into point keeps its speed on screen. Parts of End which aren't
+// given are the same as at start.
+struct SequenceOptions {
+  unsigned Frames = 0;
+  Viewport End;
+  // If not empty, frames are appended to this file ("-" is stdout) as
+  // binary PPM instead of being written as numbered images.
+  std::string Video;
+};
+
+static Viewport getFrameView(const Viewport &Start, const SequenceOptions &Seq, unsigned Frame) {
+  if (Seq.Frames < 2)
+    return Start;
+  FloatType T = static_cast<FloatType>(Frame) / (Seq.Frames - 1);
+  Viewport View = Start;
+  View.Scale = Start.Scale * std::pow(Seq.End.Scale / Start.Scale, T);
+  // Share of the way in widths of view, T itself for pan.
+  FloatType Way = T;
+  if (Seq.End.Scale != Start.Scale)
+    Way = (1 / View.Scale - 1 / Start.Scale) / (1 / Seq.End.Scale - 1 / Start.Scale);
+  View.CX = Start.CX + (Seq.End.CX - Start.CX) * Way;
+  View.CY = Start.CY + (Seq.End.CY - Start.CY) * Way;
+  return View;
+}
+
+// Image.png -> Image007.png. All frames have the same number of digits.
+static std::string getFrameName(const std::string &FileName, unsigned Frame, unsigned Frames) {
+  std::string Num = std::to_string(Frame);
+  std::string::size_type Digits = std::to_string(Frames - 1).size();
+  return addSuffix(FileName, std::string(Digits - Num.size(), '0') + Num);
+}
+
+// Renders frames of sequence with GetBand as in renderImage. Every
+// frame reuses points of previous one which are exactly at its pixels,
+// e.g. all but new columns of pan by whole pixels or every other pixel
+// of zoom by factor 2, so frames are rendered one after another (tiles
+// of frame are rendered in parallel). Frame is written by background
+// task while the next one is rendered.
+template<typename GetBandTy>
+static void renderSequence(GetBandTy GetBand, const SequenceOptions &Seq,
+                           const std::string &FileName, RenderOptions Opts) {
+  std::ofstream VideoFile;
+  std::ostream *Video = nullptr;
+  if (Seq.Video == "-") {
+    Video = &std::cout;
+  } else if (!Seq.Video.empty()) {
+    VideoFile.open(Seq.Video, std::ios::binary);
+    if (!VideoFile)
+      throw std::runtime_error("Can't open " + Seq.Video);
+    Video = &VideoFile;
+  }
+
+  // Levels of every frame would be different, so frames would flicker.
+  Opts.ToneMap = false;
+  const Viewport Start = Opts.View;
+  Viewport PrevView = Start;
+  std::vector<PackedPoint> Prev;
+  std::future<void> Pending;
+  for (unsigned Frame = 0; Frame < Seq.Frames; ++Frame) {
+    Opts.View = getFrameView(Start, Seq, Frame);
+    std::unique_ptr<RenderProfile> Profile = makeProfile(Opts);
+    std::size_t Size = std::size_t(Opts.View.Width) * Opts.View.Height;
+
+    ReusedPoints Reused;
+    if (!Prev.empty()) {
+      Reused = ReusedPoints(Prev.data(), PrevView, Opts.View);
+      std::cerr << "Frame " << Frame << ": " << Reused.getNumCovered() << " of " << Size
+                << " points are taken from previous frame\n";
+    }
+    FractalResult Res = GetBand(Opts, 0, Opts.View.Height, &Reused, Profile.get());
+    Prev.resize(Size);
+    for (std::size_t Idx = 0; Idx < Size; ++Idx)
+      Prev[Idx] = Res.getPacked(Idx);
+    PrevView = Opts.View;
+
+    std::string FrameName = getFrameName(FileName, Frame, Seq.Frames);
+    auto Draw = [Res = std::move(Res), Video, FrameName, &Seq, Opts,
+                 Profile = std::move(Profile)] {
+      if (Video)
+        drawFrame(Res, *Video, Seq.Video, Opts, Profile.get());
+      else
+        drawFractal(Res, FrameName, Opts, Profile.get());
+      reportProfile(FrameName, Opts, Profile.get());
+    };
+    if (Pending.valid())
+      Pending.get();
+    Pending = std::async(std::launch::async, std::move(Draw));
+  }
+  if (Pending.valid())
+    Pending.get();
+  if (Video && !Video->flush())
+    throw std::runtime_error("Can't write " + Seq.Video);
+}
+
+// Renders every expression of config file in one process.
+// Image of expression number N is written into FractalImageN.png.
+// Image is encoded and written while the next one is rendered.
+// Failed images are reported and counted, others are still rendered.
+static int renderBatch(const std::string &CfgName, RenderOptions Opts) {
+  int Failed = 0;
+  std::future<void> Pending;
+  for (const ExprEntry &E : loadConfigExprs(CfgName)) {
+    std::unique_ptr<RenderProfile> Profile = makeProfile(Opts);
+    ExprProgram Fn, Diff;
+    try {
+      timePhase(Profile.get(), RenderProfile::Phase::Setup, [&] {
+          Fn = ExprProgram::compile(E.Expr);
+          Diff = ExprProgram::compile(E.DiffExpr);
+        });
+    } catch (const ExprError &Err) {
+      std::cerr << "Expression " << E.Num << ": " << Err.what() << '\n';
+      ++Failed;
+      continue;
+    }
+    if (methodUsesDiff() && !Diff.isDefined()) {
+      std::cerr << "Expression " << E.Num << ": derivative is required for this method\n";
+      ++Failed;
+      continue;
+    }
+
+    Opts.Seed = std::strtoull(E.Num.c_str(), nullptr, 10);
+    // Errors of writing name their image: it may be the previous one,
+    // whose task is waited for here.
+    try {
+      renderImage([&Fn, &Diff](const RenderOptions &Opts, int Begin, int End,
+                               const ReusedPoints *Reused, RenderProfile *Profile) {
+                    return getFractal(Fn, Diff, Opts, Begin, End, Reused, Profile);
+                  },
+                  getResultKey(E.Expr, E.DiffExpr, Opts), "FractalImage" + E.Num + ".png",
+                  Opts, std::move(Profile), &Pending);
+    } catch (const std::exception &Err) {
+      std::cerr << Err.what() << '\n';
+      ++Failed;
+    }
+  }
+  if (Pending.valid()) {
+    try {
+      Pending.get();
+    } catch (const std::exception &Err) {
+      std::cerr << Err.what() << '\n';
+      ++Failed;
+    }
+  }
+  return Failed ? 1 : 0;
+}
+
+// Renders image by command line arguments (without program name) and
+// returns exit code. Serve is true if arguments are sent to --serve.
+static int runFracGen(const std::vector<std::string> &Args, bool Serve) {
+  RenderOptions Opts;
+  std::string Expr, DiffExpr, CfgName, ModuleName;
+  std::optional<DeepFloatType> EndCX, EndCY;
+  std::optional<FloatType> EndScale;
+  std::string OutName = "FractalImage.png";
+  bool Screen = false;
+  ScreenThresholds Thresholds;
+  SequenceOptions Seq;
+
+  for (const std::string &Arg : Args) {
+    std::string Val;
+    if (getOption(Arg, "threads", Val)) {
+      Opts.Threads = std::strtoul(Val.c_str(), nullptr, 10);
+      if (Opts.Threads == 0)
+        Opts.Threads = getDefaultThreads();
+    } else if (getOption(Arg, "x-center", Val)) {
+      Opts.View.CX = std::strtold(Val.c_str(), nullptr);
+    } else if (getOption(Arg, "y-center", Val)) {
+      Opts.View.CY = std::strtold(Val.c_str(), nullptr);
+    } else if (getOption(Arg, "scale", Val)) {
+      Opts.View.Scale = std::strtod(Val.c_str(), nullptr);
+      if (!(Opts.View.Scale > 0)) {
+        std::cerr << "Scale should be positive\n";
+        return 1;
+      }
+    } else if (getOption(Arg, "width", Val)) {
+      Opts.View.Width = std::strtoul(Val.c_str(), nullptr, 10);
+    } else if (getOption(Arg, "height", Val)) {
+      Opts.View.Height = std::strtoul(Val.c_str(), nullptr, 10);
+    } else if (getOption(Arg, "iters", Val)) {
+      Opts.Limits.MaxIters = std::atoi(Val.c_str());
+    } else if (getOption(Arg, "epsilon", Val)) {
+      Opts.Limits.Epsilon = std::strtod(Val.c_str(), nullptr);
+      if (!(Opts.Limits.Epsilon > 0)) {
+        std::cerr << "Epsilon should be positive\n";
+        return 1;
+      }
+    } else if (Arg == "--stop-cycles") {
+      Opts.Limits.StopCycles = true;
+    } else if (getOption(Arg, "seed", Val)) {
+      Opts.Seed = std::strtoull(Val.c_str(), nullptr, 10);
+    } else if (getOption(Arg, "depth", Val)) {
+      Opts.Depth = std::strtoul(Val.c_str(), nullptr, 10);
+      if (Opts.Depth != 8 && Opts.Depth != 16) {
+        std::cerr << "Depth should be 8 or 16\n";
+        return 1;
+      }
+    } else if (getOption(Arg, "band", Val)) {
+      Opts.BandHeight = std::strtoul(Val.c_str(), nullptr, 10);
+    } else if (getOption(Arg, "cache", Val)) {
+      Opts.CacheDir = Val;
+    } else if (Arg == "--adaptive") {
+      Opts.Adaptive = true;
+    } else if (getOption(Arg, "antialias", Val)) {
+      Opts.Antialias = std::strtoul(Val.c_str(), nullptr, 10);
+    } else if (getOption(Arg, "palette", Val)) {
+      if (!Palette::parse(Val, Opts.Colors)) {
+        std::cerr << "Unknown palette '" << Val << "'\n";
+        return 1;
+      }
+    } else if (Arg == "--no-tone-map") {
+      Opts.ToneMap = false;
+    } else if (Arg == "--profile") {
+      Opts.Profile = true;
+    } else if (Arg == "--heatmap") {
+      Opts.Heatmap = true;
+    } else if (Arg == "--builtin-writer") {
+      Opts.BuiltinWriter = true;
+    } else if (getOption(Arg, "expr", Val)) {
+      Expr = Val;
+    } else if (getOption(Arg, "diff-expr", Val)) {
+      DiffExpr = Val;
+    } else if (getOption(Arg, "output", Val)) {
+      OutName = Val;
+    } else if (getOption(Arg, "module", Val)) {
+      ModuleName = Val;
+    } else if (getOption(Arg, "config", Val)) {
+      CfgName = Val;
+    } else if (getOption(Arg, "frames", Val)) {
+      Seq.Frames = std::strtoul(Val.c_str(), nullptr, 10);
+    } else if (getOption(Arg, "end-x", Val)) {
+      EndCX = std::strtold(Val.c_str(), nullptr);
+    } else if (getOption(Arg, "end-y", Val)) {
+      EndCY = std::strtold(Val.c_str(), nullptr);
+    } else if (getOption(Arg, "end-scale", Val)) {
+      EndScale = std::strtod(Val.c_str(), nullptr);
+      if (!(*EndScale > 0)) {
+        std::cerr << "Scale should be positive\n";
+        return 1;
+      }
+    } else if (getOption(Arg, "video", Val)) {
+      Seq.Video = Val;
+    } else if (Arg == "--screen") {
+      Screen = true;
+    } else if (getOption(Arg, "min-converged", Val)) {
+      Thresholds.MinConverged = std::strtod(Val.c_str(), nullptr);
+    } else if (getOption(Arg, "min-entropy", Val)) {
+      Thresholds.MinEntropy = std::strtod(Val.c_str(), nullptr);
+    } else {
+      std::cerr << "Unknown option '" << Arg << "'\n";
+      return 1;
+    }
+  }
+
+  if (!Opts.View.Width || !Opts.View.Height || Opts.Limits.MaxIters <= 0) {
+    std::cerr << "Size of image and number of iterations should be positive\n";
+    return 1;
+  }
+  Seq.End = Opts.View;
+  Seq.End.CX = EndCX.value_or(Opts.View.CX);
+  Seq.End.CY = EndCY.value_or(Opts.View.CY);
+  Seq.End.Scale = EndScale.value_or(Opts.View.Scale);
+
+  if (Screen && !CfgName.empty()) {
+    std::cerr << "Only single expression can be screened\n";
+    return 1;
+  }
+  if (Seq.Frames && (!CfgName.empty() || Screen || Opts.BandHeight || !Opts.CacheDir.empty())) {
+    std::cerr << "Sequence can't be rendered with --config, --screen, --band or --cache\n";
+    return 1;
+  }
+  if (!Seq.Video.empty() && !Seq.Frames) {
+    std::cerr << "--video needs --frames\n";
+    return 1;
+  }
+  if (!ModuleName.empty() && (!CfgName.empty() || !Expr.empty())) {
+    std::cerr << "Module can't be used with --config or --expr\n";
+    return 1;
+  }
+  // Stdout of server is for replies only.
+  if (Serve && Seq.Video == "-") {
+    std::cerr << "Video can't be written to stdout of --serve\n";
+    return 1;
+  }
+
+  try {
+    if (!CfgName.empty())
+      return renderBatch(CfgName, Opts);
+
+    std::unique_ptr<RenderProfile> Profile = makeProfile(Opts);
+    if (!Expr.empty()) {
+      ExprProgram Fn, Diff;
+      timePhase(Profile.get(), RenderProfile::Phase::Setup, [&] {
+          Fn = ExprProgram::compile(Expr);
+          if (!DiffExpr.empty())
+            Diff = ExprProgram::compile(DiffExpr);
+        });
+      if (methodUsesDiff() && !Diff.isDefined()) {
+        std::cerr << "--diff-expr is required for this method\n";
+        return 1;
+      }
+      if (Screen)
+        return reportScreen(screenFractal(Fn, Diff, Opts), Thresholds);
+      auto GetBand = [&Fn, &Diff](const RenderOptions &Opts, int Begin, int End,
+                                  const ReusedPoints *Reused, RenderProfile *Profile) {
+        return getFractal(Fn, Diff, Opts, Begin, End, Reused, Profile);
+      };
+      if (Seq.Frames)
+        renderSequence(GetBand, Seq, OutName, Opts);
+      else
+        renderImage(GetBand, getResultKey(Expr, DiffExpr, Opts), OutName, Opts,
+                    std::move(Profile));
+      return 0;
+    }
+
+    // Module is unloaded when this run returns.
+    std::optional<LoadedModule> Module;
+    const CompiledFractal *Fractal = &getLinkedFractal();
+    if (!ModuleName.empty())
+      timePhase(Profile.get(), RenderProfile::Phase::Setup, [&] {
+          Module.emplace(ModuleName);
+          Fractal = &Module->getFractal();
+        });
+    if (Screen)
+      return reportScreen(Fractal->ScreenFractal(Opts), Thresholds);
+    auto GetBand = [Fractal](const RenderOptions &Opts, int Begin, int End,
+                             const ReusedPoints *Reused, RenderProfile *Profile) {
+      return Fractal->GetFractal(Opts, Begin, End, Reused, Profile);
+    };
+    if (Seq.Frames)
+      renderSequence(GetBand, Seq, OutName, Opts);
+    else
+      renderImage(GetBand, Fractal->GetResultKey(Opts), OutName, Opts, std::move(Profile));
+  } catch (const std::runtime_error &Err) {
+    std::cerr << Err.what() << '\n';
+    return 1;
+  }
   return 0;
 }
+
+// Renders images one after another by lines of stdin: line has
+// arguments of one run separated by tabs. "done <exit code>" is written
+// to stdout after each of them. Together with --module the expression
+// can be changed without start of new process (frac-gen.rb --modules).
+static int serve() {
+  std::string Line;
+  while (std::getline(std::cin, Line)) {
+    std::vector<std::string> Args;
+    std::istringstream Fields(Line);
+    for (std::string Arg; std::getline(Fields, Arg, '\t');)
+      if (!Arg.empty())
+        Args.push_back(Arg);
+    int Code = runFracGen(Args, true);
+    std::cerr.flush();
+    std::cout << "done " << Code << std::endl;
+  }
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc == 2 && std::string(argv[1]) == "--serve")
+    return serve();
+  return runFracGen(std::vector<std::string>(argv + 1, argv + argc), false);
+}
@@ -1,53 +1,458 @@
+#include "Adaptive.hpp"
+#include "Cache.h"
 #include "Color.h"
 #include "Config.h"
+#include "Deep.hpp"
+#include "Expr.h"
 #include "Norm.h"
 #include "Methods.hpp"
+#include "Module.h"
+#include "Options.h"
+#include "Palette.h"
+#include "Parallel.hpp"
+#include "Profile.h"
+#include "Result.h"
+#include "Screen.h"
+#include "Support.hpp"
 #include "TypeHelpers.hpp"
 #include "Types.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <tuple>
 #include <utility>
 #include <vector>
 
 #include <cassert>
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 
-auto getFractal() -> std::vector<PtColor> {
-  std::vector<PtColor> ColorIdxs;
-  ColorIdxs.reserve(XLen * YLen);
+// Side of square block of pixels scheduled as one job.
+constexpr int TileSize = 32;
+// Adaptive mode gains more on larger blocks.
+constexpr int AdaptiveTileSize = 64;
+// Neighbouring pixels are on different sides of edge if their colors
+// differ by more than that in some channel.
+constexpr double EdgeColorDiff = 1.0 / 16;
 
-  struct Func {
-    ValType operator()(ValType Pt) {
-      static auto Fn = [](ValType Pt) -> ValType {
-        <%= expr %>
-      };
-      return Fn(Pt);
-    }
+using Method = CalcNext<%= method %>;
+constexpr const char *MethodName = "<%= method %>";
 
-    static ValType diff(ValType Pt) {
-      static auto FnDiff = [](ValType Pt) -> ValType {
-        <%= expr_diff %>
-      };
-      return FnDiff(Pt);
-    }
+// Number of points iterated in lockstep by compiled expression.
+// Zero if expression or method can't work on lanes.
+constexpr unsigned BatchWidth = <%= batch_width %>;
+
+// Compiled expression iterates pixels as offsets from reference orbit
+// of center (see Deep.hpp). Only batchable methods can do that.
+constexpr bool DeepZoom = <%= deep_zoom %> && IsBatchableV<Method>;
+
+// Pixels of Res (rows [RowBegin, RowEnd) of image) whose color differs
+// from color of one of their neighbours by more than EdgeColorDiff in
+// some channel (different roots, iteration bands or convergence) get
+// Opts.Antialias more samples at random points inside them, which are
+// kept in Res to be averaged by palette (see Drawer.cpp). Colors are
+// compared in palette of Opts. Neighbours are looked for only among
+// rows of Res, so edges along borders of bands aren't smoothed. Random points
+// depend only on seed of image and pixel. GetSample(Fn, i, j, DX, DY,
+// Seed) calculates point at offset (DX, DY) from center of pixel (i, j).
+template<typename WithFnTy, typename GetSampleTy>
+static void antialiasFractal(FractalResult &Res, const RenderOptions &Opts, int RowBegin,
+                             int RowEnd, int Side, WithFnTy WithFn, GetSampleTy GetSample) {
+  using RGBColor = Palette::RGBColor;
+  const Palette &Colors = Palette::get(Opts.Colors);
+  int Width = Opts.View.Width;
+  int XTiles = (Width + Side - 1) / Side;
+  int YTiles = (RowEnd - RowBegin + Side - 1) / Side;
+
+  // Colors of pixels are compared with neighbours several times.
+  std::vector<RGBColor> PixelColors(std::size_t(Width) * (RowEnd - RowBegin));
+  parallelTiles(Opts.Threads, RowEnd - RowBegin, [&](IdxType Row) {
+      for (int i = 0; i < Width; ++i) {
+        std::size_t Idx = Res.getIndex(i, Row);
+        PixelColors[Idx] = Colors.getColor(Res.getPacked(Idx));
+      }
+    });
+
+  auto IsEdge = [&PixelColors, &Res, Width, RowBegin, RowEnd](const RGBColor &C, int i, int j) {
+    if (i < 0 || i >= Width || j < RowBegin || j >= RowEnd)
+      return false;
+    const RGBColor &N = PixelColors[Res.getIndex(i, j - RowBegin)];
+    return std::fabs(std::get<0>(C) - std::get<0>(N)) > EdgeColorDiff ||
+      std::fabs(std::get<1>(C) - std::get<1>(N)) > EdgeColorDiff ||
+      std::fabs(std::get<2>(C) - std::get<2>(N)) > EdgeColorDiff;
+  };
+
+  // Uniform in [-0.5, 0.5).
+  auto GetJitter = [](SplitMix64 &Rnd) {
+    return static_cast<FloatType>(Rnd() >> 11) * 0x1p-53 - 0.5;
+  };
+
+  std::vector<std::vector<FractalResult::Supersampled>> TilePixels(XTiles * YTiles);
+  parallelTiles(Opts.Threads, XTiles * YTiles, [&](IdxType Tile) {
+      int XBegin = static_cast<int>(Tile) % XTiles * Side;
+      int YBegin = RowBegin + static_cast<int>(Tile) / XTiles * Side;
+      int XEnd = std::min(XBegin + Side, Width);
+      int YEnd = std::min(YBegin + Side, RowEnd);
+
+      WithFn([&](auto Fn) {
+          for (int j = YBegin; j < YEnd; ++j)
+            for (int i = XBegin; i < XEnd; ++i) {
+              std::size_t Idx = Res.getIndex(i, j - RowBegin);
+              const RGBColor &C = PixelColors[Idx];
+              if (!IsEdge(C, i - 1, j) && !IsEdge(C, i + 1, j) && !IsEdge(C, i, j - 1) &&
+                  !IsEdge(C, i, j + 1))
+                continue;
+
+              FractalResult::Supersampled Pixel{Idx, {}};
+              Pixel.Samples.reserve(Opts.Antialias);
+              SplitMix64 Rnd(mixBits(getPixelSeed(Opts.Seed, i, j)));
+              for (unsigned k = 0; k < Opts.Antialias; ++k) {
+                FloatType DX = GetJitter(Rnd);
+                FloatType DY = GetJitter(Rnd);
+                Pixel.Samples.push_back(PackedPoint::pack(GetSample(Fn, i, j, DX, DY, Rnd())));
+              }
+              TilePixels[Tile].push_back(std::move(Pixel));
+            }
+        });
+    });
+
+  std::vector<FractalResult::Supersampled> Pixels;
+  for (auto &P : TilePixels)
+    std::move(P.begin(), P.end(), std::back_inserter(Pixels));
+  std::cerr << "Supersampled " << Pixels.size() << " edge pixels\n";
+  Res.setSupersampled(std::move(Pixels));
+}
+
+// Renders rows [RowBegin, RowEnd) of image of Opts.View with function
+// given by WithFn. WithFn(Body) should call Body with function object
+// private to calling tile (e.g. for scratch data). If Lanes is not zero
+// function should accept ComplexLanes<Lanes, IterFloatType> too. Points
+// found in Reused (from cache or previous frame) aren't calculated.
+// Calculated points are recorded in Profile if it is given. If Deep is
+// set function should accept DeepComplex and Lanes should be zero.
+// Edge pixels are supersampled if Opts.Antialias is set.
+template<unsigned Lanes, bool Deep, typename WithFnTy>
+static auto renderFractal(const RenderOptions &Opts, int RowBegin, int RowEnd,
+                          const ReusedPoints *Reused, RenderProfile *Profile,
+                          WithFnTy WithFn) -> FractalResult {
+  using Phase = RenderProfile::Phase;
+  const Viewport &View = Opts.View;
+  int Width = View.Width;
+  FractalResult Res(Width, RowEnd - RowBegin);
+
+  auto Lookup = [Reused](int i, int j) -> const PackedPoint * {
+    return Reused ? Reused->lookup(i, j) : nullptr;
   };
 
-  static auto ColorFn = [](ValType Pt, int Iters) {
-    return PointColor(Pt, Iters);
+  const IterLimits Limits = Opts.Limits;
+  auto ColorFn = [Epsilon = Limits.Epsilon](ValType Pt, int Iters) {
+    return PointColor(Pt, Epsilon, Iters);
   };
 
-  using Method = CalcNext<%= method %>;
+  // Reference orbit of deep zoom is shared by all tiles.
+  DeepOrbit Orbit;
+  if constexpr (Deep)
+    WithFn([&](auto Fn) {
+        Orbit = DeepOrbit::calculate<Method>(Fn, DeepComplex(View.CX, View.CY),
+                                             Limits.MaxIters);
+      });
 
-  for (int i = -XLen / 2; i < XLen / 2; ++i) {
-    FloatType X = static_cast<FloatType>(i) / Scale + CX;
-    for (int j = -YLen / 2; j < YLen / 2; ++j) {
-      FloatType Y = static_cast<FloatType>(j) / Scale + CY;
-      ColorIdxs.emplace_back(getPointIndexN<Method>(Func(), UsedNorm, ColorFn, ValType(X, Y)));
+  auto GetPoint = [Profile, &Opts, &View, &Orbit, &ColorFn,
+                   Limits](auto Fn, int i, int j) -> PtColor {
+    if constexpr (Deep) {
+      std::chrono::steady_clock::time_point Start;
+      if (Profile)
+        Start = std::chrono::steady_clock::now();
+      auto Res = getPointIndexDeep<Method>(Fn, UsedNorm, ColorFn, Limits, Orbit,
+                                           ValType(View.getOffsetX(i), View.getOffsetY(j)));
+      if (Profile) {
+        Profile->addTime(Phase::Iterate, std::chrono::steady_clock::now() - Start);
+        Profile->setPoint(i, j, Res.second.Iters, Res.first.first, Res.second.NaN,
+                          Res.second.Cycled);
+      }
+      return Res.first;
     }
+
+    ValType Pt(View.getX(i), View.getY(j));
+    if (!Profile)
+      return getPointIndexN<Method>(Fn, UsedNorm, ColorFn, Limits, Pt,
+                                    getPixelSeed(Opts.Seed, i, j));
+
+    PointStats Stats;
+    Stats.Timed = true;
+    PtColor Res = getPointIndexN<Method>(Fn, UsedNorm, ColorFn, Limits, Pt,
+                                         getPixelSeed(Opts.Seed, i, j), &Stats);
+    Profile->addTime(Phase::Bootstrap, Stats.BootstrapTime);
+    Profile->addTime(Phase::Iterate, Stats.IterateTime);
+    Profile->setPoint(i, j, Stats.Iters, Res.first, Stats.NaN, Stats.Cycled);
+    return Res;
+  };
+
+  // Point at fractional offset (DX, DY) from center of pixel (i, j).
+  auto GetSample = [&View, &Orbit, &ColorFn, Limits](auto Fn, int i, int j, FloatType DX,
+                                                     FloatType DY,
+                                                     std::uint64_t Seed) -> PtColor {
+    FloatType OffsetX = View.getOffsetX(i) + DX / View.Scale;
+    FloatType OffsetY = View.getOffsetY(j) + DY / View.Scale;
+    if constexpr (Deep)
+      return getPointIndexDeep<Method>(Fn, UsedNorm, ColorFn, Limits, Orbit,
+                                       ValType(OffsetX, OffsetY)).first;
+    else
+      return getPointIndexN<Method>(Fn, UsedNorm, ColorFn, Limits,
+                                    ValType(OffsetX + static_cast<FloatType>(View.CX),
+                                            OffsetY + static_cast<FloatType>(View.CY)),
+                                    Seed);
+  };
+
+  int Side = Opts.Adaptive ? AdaptiveTileSize : TileSize;
+  int XTiles = (Width + Side - 1) / Side;
+  int YTiles = (RowEnd - RowBegin + Side - 1) / Side;
+
+  // Every pixel has its own slot so tiles can be filled in any order.
+  std::atomic<std::uint64_t> Evaluated(0);
+  auto RenderTile = [&](IdxType Tile) {
+    int XBegin = static_cast<int>(Tile) % XTiles * Side;
+    int YBegin = RowBegin + static_cast<int>(Tile) / XTiles * Side;
+    int XEnd = std::min(XBegin + Side, Width);
+    int YEnd = std::min(YBegin + Side, RowEnd);
+
+    WithFn([&](auto Fn) {
+      if (Opts.Adaptive) {
+        AdaptiveBlock Block(XEnd - XBegin, YEnd - YBegin);
+        Block.render([&](int X, int Y) {
+            int i = XBegin + X, j = YBegin + Y;
+            if (const PackedPoint *Cached = Lookup(i, j))
+              return Cached->unpack();
+            return GetPoint(Fn, i, j);
+          });
+        for (int j = YBegin; j < YEnd; ++j)
+          for (int i = XBegin; i < XEnd; ++i)
+            Res.set(Res.getIndex(i, j - RowBegin), Block.getPoint(i - XBegin, j - YBegin));
+        Evaluated += Block.getNumEvaluated();
+        return;
+      }
+
+      for (int j = YBegin; j < YEnd; ++j) {
+        if constexpr (Lanes > 0 && IsBatchableV<Method>) {
+          FloatType Y = View.getY(j);
+          // Last batch of row is padded with its last point.
+          for (int i = XBegin; i < XEnd; i += Lanes) {
+            int Count = std::min<int>(Lanes, XEnd - i);
+            bool AllCached = true;
+            for (int k = 0; k < Count; ++k)
+              AllCached &= Lookup(i + k, j) != nullptr;
+            if (AllCached) {
+              for (int k = 0; k < Count; ++k)
+                Res.set(Res.getIndex(i + k, j - RowBegin), *Lookup(i + k, j));
+              continue;
+            }
+
+            ValType Init[Lanes];
+            for (unsigned k = 0; k < Lanes; ++k) {
+              int Col = std::min(i + static_cast<int>(k), XEnd - 1);
+              Init[k] = ValType(View.getX(Col), Y);
+            }
+            std::chrono::steady_clock::time_point Start;
+            if (Profile)
+              Start = std::chrono::steady_clock::now();
+            getPointIndexBatch<Method, Lanes>(Fn, UsedNorm, ColorFn, Limits, Init, Count,
+                                              [&, i, j](unsigned k, const PtColor &Pt,
+                                                        const PointStats &Stats) {
+                                                Res.set(Res.getIndex(i + k, j - RowBegin), Pt);
+                                                if (Profile)
+                                                  Profile->setPoint(i + k, j, Stats.Iters,
+                                                                    Pt.first, Stats.NaN,
+                                                                    Stats.Cycled);
+                                              });
+            if (Profile)
+              Profile->addTime(Phase::Iterate, std::chrono::steady_clock::now() - Start);
+          }
+        } else {
+          for (int i = XBegin; i < XEnd; ++i) {
+            if (const PackedPoint *Cached = Lookup(i, j)) {
+              Res.set(Res.getIndex(i, j - RowBegin), *Cached);
+              continue;
+            }
+            Res.set(Res.getIndex(i, j - RowBegin), GetPoint(Fn, i, j));
+          }
+        }
+      }
+    });
     std::cerr << '.';
-  }
+  };
+  parallelTiles(Opts.Threads, XTiles * YTiles, RenderTile);
   std::cerr << '\n';
+  if (Opts.Adaptive)
+    std::cerr << "Evaluated " << Evaluated << " of " << std::uint64_t(Width) * (RowEnd - RowBegin)
+              << " points\n";
+
+  if (Opts.Antialias)
+    timePhase(Profile, Phase::Antialias, [&] {
+        antialiasFractal(Res, Opts, RowBegin, RowEnd, Side, WithFn, GetSample);
+      });
+
+  return Res;
+}
+
+// Renders low-resolution probe of the same part of plane as image.
+template<bool Deep, typename WithFnTy>
+static auto screenFractal(const RenderOptions &Opts, WithFnTy WithFn) -> ScreenResult {
+  const IterLimits Limits = Opts.Limits;
+  auto ColorFn = [Epsilon = Limits.Epsilon](ValType Pt, int Iters) {
+    return PointColor(Pt, Epsilon, Iters);
+  };
+
+  const Viewport &View = Opts.View;
+  unsigned Height = std::max(1U, ScreenSide * View.Height / View.Width);
+  Viewport ProbeView{View.CX, View.CY, View.Scale * ScreenSide / View.Width, ScreenSide, Height};
+  FractalResult Probe(ScreenSide, Height);
+  DeepOrbit Orbit;
+  if constexpr (Deep)
+    WithFn([&](auto Fn) {
+        Orbit = DeepOrbit::calculate<Method>(Fn, DeepComplex(View.CX, View.CY),
+                                             Limits.MaxIters);
+      });
+  parallelTiles(Opts.Threads, Height, [&](IdxType Row) {
+    int j = static_cast<int>(Row);
+    WithFn([&](auto Fn) {
+      for (int i = 0; i < ScreenSide; ++i) {
+        if constexpr (Deep) {
+          ValType Offset(ProbeView.getOffsetX(i), ProbeView.getOffsetY(j));
+          Probe.set(Probe.getIndex(i, j),
+                    getPointIndexDeep<Method>(Fn, UsedNorm, ColorFn, Limits, Orbit,
+                                              Offset).first);
+        } else {
+          Probe.set(Probe.getIndex(i, j),
+                    getPointIndexN<Method>(Fn, UsedNorm, ColorFn, Limits,
+                                           ValType(ProbeView.getX(i), ProbeView.getY(j)),
+                                           getPixelSeed(Opts.Seed, i, j)));
+        }
+      }
+    });
+  });
+  return getScreenResult(Probe);
+}
+
+namespace {
+
+// Expression compiled into FracGen. Works on ValType, ComplexLanes and
+// DeepComplex. Bodies are optimized by frac-gen.rb (Scripts/exprcode.rb).
+struct Func {
+  template<typename T>
+  T operator()(T Pt) {
+    static auto Fn = [](auto Pt) -> decltype(Pt) {
+      <%= expr_code %>
+    };
+    return Fn(Pt);
+  }
+
+  template<typename T>
+  static T diff(T Pt) {
+    static auto FnDiff = [](auto Pt) -> decltype(Pt) {
+      <%= expr_diff_code %>
+    };
+    return FnDiff(Pt);
+  }
+<% if expr_fused_code %>
+
+  // Value and derivative with common subexpressions calculated once.
+  template<typename T>
+  static std::pair<T, T> withDiff(T Pt) {
+    static auto FnWithDiff = [](auto Pt) -> std::pair<decltype(Pt), decltype(Pt)> {
+      <%= expr_fused_code %>
+    };
+    return FnWithDiff(Pt);
+  }
+<% end %>
+};
+
+} // namespace
+
+// Fast path: expression is compiled into FracGen.
+auto getFractal(const RenderOptions &Opts, int RowBegin, int RowEnd,
+                const ReusedPoints *Reused, RenderProfile *Profile) -> FractalResult {
+  return renderFractal<DeepZoom ? 0 : BatchWidth, DeepZoom>(Opts, RowBegin, RowEnd, Reused,
+                                                            Profile,
+                                                            [](auto Body) { Body(Func()); });
+}
 
-  return ColorIdxs;
+// Modules (see Module.h) have only compiled expression, interpreter
+// is in FracGen itself.
+#ifndef FRACGEN_MODULE
+// Interpreted derivative is needed only by methods which use it.
+auto methodUsesDiff() -> bool {
+  return UsesDiffV<Method>;
+}
+
+// Expression is given at runtime and interpreted.
+auto getFractal(const ExprProgram &Fn, const ExprProgram &Diff, const RenderOptions &Opts,
+                int RowBegin, int RowEnd, const ReusedPoints *Reused,
+                RenderProfile *Profile) -> FractalResult {
+  return renderFractal<0, false>(Opts, RowBegin, RowEnd, Reused, Profile, [&Fn, &Diff](auto Body) {
+      ExprContext Ctx(Fn, Diff);
+      Body(Ctx.getFunc());
+    });
+}
+
+auto screenFractal(const ExprProgram &Fn, const ExprProgram &Diff,
+                   const RenderOptions &Opts) -> ScreenResult {
+  return screenFractal<false>(Opts, [&Fn, &Diff](auto Body) {
+      ExprContext Ctx(Fn, Diff);
+      Body(Ctx.getFunc());
+    });
+}
+#endif
+
+auto screenFractal(const RenderOptions &Opts) -> ScreenResult {
+  return screenFractal<DeepZoom>(Opts, [](auto Body) { Body(Func()); });
+}
+
+// Key of result cache: everything that affects points except viewport.
+// Only compiled expression is iterated in SIMD lanes or as deep zoom,
+// so only it can have precision other than double.
+static std::string getResultKey(const std::string &Expr, const std::string &DiffExpr,
+                                const RenderOptions &Opts, const char *PrecisionName) {
+  std::ostringstream Key;
+  Key.precision(17);
+  Key << "method=" << MethodName << "\nnorm=" << UsedNormName
+      << "\nepsilon=" << Opts.Limits.Epsilon << "\niters=" << Opts.Limits.MaxIters
+      << "\nstop-cycles=" << Opts.Limits.StopCycles << "\nseed=" << Opts.Seed
+      << "\nadaptive=" << Opts.Adaptive << "\nprecision=" << PrecisionName
+      << "\nexpr=" << Expr << "\ndiff=" << DiffExpr;
+  return Key.str();
+}
+
+#ifndef FRACGEN_MODULE
+auto getResultKey(const std::string &Expr, const std::string &DiffExpr,
+                  const RenderOptions &Opts) -> std::string {
+  return getResultKey(Expr, DiffExpr, Opts, "Double");
+}
+#endif
+
+auto getResultKey(const RenderOptions &Opts) -> std::string {
+  return getResultKey(R"FRACGEN(<%= expr %>)FRACGEN", R"FRACGEN(<%= expr_diff %>)FRACGEN", Opts,
+                      DeepZoom ? "Deep" : BatchWidth ? UsedPrecisionName : "Double");
+}
+
+#ifdef FRACGEN_MODULE
+// Entry point of module. The rest of it is hidden, so it doesn't
+// interpose symbols of FracGen.
+extern "C" __attribute__((visibility("default")))
+const CompiledFractal *FRACGEN_MODULE_ENTRY() {
+  static const CompiledFractal Fractal{sizeof(RenderOptions), sizeof(FractalResult), getFractal,
+                                       screenFractal, getResultKey};
+  return &Fractal;
+}
+#else
+auto getLinkedFractal() -> const CompiledFractal & {
+  static const CompiledFractal Fractal{sizeof(RenderOptions), sizeof(FractalResult), getFractal,
+                                       screenFractal, getResultKey};
+  return Fractal;
 }
+#endif
@@ -0,0 +1,45 @@
+#ifndef FRACGEN_IMAGE_H_DEFINED__
+#define FRACGEN_IMAGE_H_DEFINED__
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+// Row-major RGB image. SampleTy is std::uint8_t or std::uint16_t
+// for 8 or 16 bits per channel.
+template<typename SampleTy>
+class RGBImage {
+  unsigned Width;
+  unsigned Height;
+  std::vector<SampleTy> Data;
+
+public:
+  static constexpr unsigned Depth = 8 * sizeof(SampleTy);
+  static constexpr SampleTy MaxSample = static_cast<SampleTy>(~SampleTy(0));
+
+  RGBImage(unsigned Width, unsigned Height):
+    Width(Width), Height(Height), Data(std::size_t(3) * Width * Height) {}
+
+  unsigned getWidth() const {
+    return Width;
+  }
+
+  unsigned getHeight() const {
+    return Height;
+  }
+
+  const SampleTy *getData() const {
+    return Data.data();
+  }
+
+  SampleTy *getRow(unsigned Y) {
+    return &Data[std::size_t(3) * Y * Width];
+  }
+
+  const SampleTy *getRow(unsigned Y) const {
+    return &Data[std::size_t(3) * Y * Width];
+  }
+};
+
+#endif
@@ -0,0 +1,205 @@
+#include "ImageWriter.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+// Maximal size of deflate stored block.
+static constexpr std::size_t MaxBlockSize = 65535;
+
+static const std::array<std::uint32_t, 256> &getCRCTable() {
+  static const std::array<std::uint32_t, 256> Table = [] {
+    std::array<std::uint32_t, 256> T;
+    for (std::uint32_t N = 0; N < 256; ++N) {
+      std::uint32_t C = N;
+      for (int k = 0; k < 8; ++k)
+        C = C & 1 ? 0xedb88320U ^ (C >> 1) : C >> 1;
+      T[N] = C;
+    }
+    return T;
+  }();
+  return Table;
+}
+
+static std::uint32_t updateCRC(std::uint32_t CRC, const std::uint8_t *Data, std::size_t Size) {
+  const auto &Table = getCRCTable();
+  for (std::size_t i = 0; i < Size; ++i)
+    CRC = Table[(CRC ^ Data[i]) & 0xff] ^ (CRC >> 8);
+  return CRC;
+}
+
+static std::uint32_t updateAdler(std::uint32_t Adler, const std::uint8_t *Data, std::size_t Size) {
+  constexpr std::uint32_t Base = 65521;
+  // Largest number of bytes which can't overflow sums before reduction.
+  constexpr std::size_t NMax = 5552;
+  std::uint32_t A = Adler & 0xffff, B = Adler >> 16;
+  while (Size) {
+    std::size_t Len = std::min(Size, NMax);
+    Size -= Len;
+    for (std::size_t i = 0; i < Len; ++i) {
+      A += Data[i];
+      B += A;
+    }
+    Data += Len;
+    A %= Base;
+    B %= Base;
+  }
+  return B << 16 | A;
+}
+
+static void putBE32(std::uint8_t *Dst, std::uint32_t V) {
+  Dst[0] = V >> 24;
+  Dst[1] = V >> 16;
+  Dst[2] = V >> 8;
+  Dst[3] = V;
+}
+
+auto ImageWriter::getFormat(const std::string &FileName) -> Format {
+  static const std::string PPMExt = ".ppm";
+  if (FileName.size() >= PPMExt.size() &&
+      FileName.compare(FileName.size() - PPMExt.size(), PPMExt.size(), PPMExt) == 0)
+    return Format::PPM;
+  return Format::PNG;
+}
+
+ImageWriter::ImageWriter(const std::string &FileName, unsigned Width, unsigned Height,
+                         unsigned Depth):
+  File(FileName, std::ios::binary), Out(File), FileName(FileName), Fmt(getFormat(FileName)),
+  Width(Width), Height(Height), Depth(Depth), RowBuf(std::size_t(3) * Width * (Depth / 8)) {
+  if (!Out)
+    throw std::runtime_error("Can't open " + FileName);
+  writeHeader();
+}
+
+ImageWriter::ImageWriter(std::ostream &Out, const std::string &Name, Format Fmt, unsigned Width,
+                         unsigned Height, unsigned Depth):
+  Out(Out), FileName(Name), Fmt(Fmt), Width(Width), Height(Height), Depth(Depth),
+  RowBuf(std::size_t(3) * Width * (Depth / 8)) {
+  writeHeader();
+}
+
+void ImageWriter::writeHeader() {
+  if (Depth != 8 && Depth != 16)
+    throw std::runtime_error("Unsupported image depth " + std::to_string(Depth));
+
+  if (Fmt == Format::PPM) {
+    std::string Header = "P6\n" + std::to_string(Width) + ' ' + std::to_string(Height) + '\n' +
+      (Depth == 8 ? "255" : "65535") + '\n';
+    writeBytes(reinterpret_cast<const std::uint8_t *>(Header.data()), Header.size());
+    return;
+  }
+
+  static const std::uint8_t Signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  writeBytes(Signature, sizeof(Signature));
+
+  // Truecolor without alpha, no interlacing.
+  std::uint8_t Header[13] = {};
+  putBE32(Header, Width);
+  putBE32(Header + 4, Height);
+  Header[8] = Depth;
+  Header[9] = 2;
+  writeChunk("IHDR", Header, sizeof(Header));
+}
+
+void ImageWriter::writeBytes(const std::uint8_t *Data, std::size_t Size) {
+  Out.write(reinterpret_cast<const char *>(Data), Size);
+  if (!Out)
+    throw std::runtime_error("Can't write " + FileName);
+}
+
+void ImageWriter::writeChunk(const char *Type, const std::uint8_t *Data, std::size_t Size) {
+  std::uint8_t Buf[4];
+  putBE32(Buf, Size);
+  writeBytes(Buf, 4);
+
+  const auto *TypeBytes = reinterpret_cast<const std::uint8_t *>(Type);
+  writeBytes(TypeBytes, 4);
+  writeBytes(Data, Size);
+
+  std::uint32_t CRC = updateCRC(0xffffffffU, TypeBytes, 4);
+  CRC = updateCRC(CRC, Data, Size) ^ 0xffffffffU;
+  putBE32(Buf, CRC);
+  writeBytes(Buf, 4);
+}
+
+// Moves pending data into IDAT chunk as stored deflate blocks.
+// Until the last flush only full blocks are written.
+void ImageWriter::flushBlocks(bool Final) {
+  if (!Final && Pending.size() < MaxBlockSize)
+    return;
+
+  std::vector<std::uint8_t> Chunk;
+  if (!StreamStarted) {
+    // zlib header: deflate with 32K window, no dictionary.
+    Chunk.push_back(0x78);
+    Chunk.push_back(0x01);
+    StreamStarted = true;
+  }
+
+  std::size_t Pos = 0;
+  do {
+    std::size_t Len = std::min(Pending.size() - Pos, MaxBlockSize);
+    bool Last = Final && Pos + Len == Pending.size();
+    if (!Last && Len < MaxBlockSize)
+      break;
+    Chunk.push_back(Last ? 1 : 0);
+    Chunk.push_back(Len & 0xff);
+    Chunk.push_back(Len >> 8);
+    Chunk.push_back(~Len & 0xff);
+    Chunk.push_back((~Len >> 8) & 0xff);
+    Adler = updateAdler(Adler, Pending.data() + Pos, Len);
+    Chunk.insert(Chunk.end(), Pending.begin() + Pos, Pending.begin() + Pos + Len);
+    Pos += Len;
+  } while (Pos < Pending.size());
+
+  if (Final) {
+    std::uint8_t Buf[4];
+    putBE32(Buf, Adler);
+    Chunk.insert(Chunk.end(), Buf, Buf + 4);
+  }
+  writeChunk("IDAT", Chunk.data(), Chunk.size());
+  Pending.erase(Pending.begin(), Pending.begin() + Pos);
+}
+
+void ImageWriter::writeEncodedRow() {
+  if (RowsWritten == Height)
+    throw std::runtime_error("Too many rows for " + FileName);
+  if (Fmt == Format::PPM) {
+    writeBytes(RowBuf.data(), RowBuf.size());
+  } else {
+    // Filter type None.
+    Pending.push_back(0);
+    Pending.insert(Pending.end(), RowBuf.begin(), RowBuf.end());
+    flushBlocks(false);
+  }
+  ++RowsWritten;
+}
+
+void ImageWriter::writeRow(const std::uint8_t *Row) {
+  if (Depth != 8)
+    throw std::runtime_error("8-bit row for 16-bit image " + FileName);
+  std::copy(Row, Row + RowBuf.size(), RowBuf.begin());
+  writeEncodedRow();
+}
+
+void ImageWriter::writeRow(const std::uint16_t *Row) {
+  if (Depth != 16)
+    throw std::runtime_error("16-bit row for 8-bit image " + FileName);
+  for (std::size_t i = 0; i < RowBuf.size() / 2; ++i) {
+    RowBuf[2 * i] = Row[i] >> 8;
+    RowBuf[2 * i + 1] = Row[i] & 0xff;
+  }
+  writeEncodedRow();
+}
+
+void ImageWriter::finish() {
+  if (RowsWritten != Height)
+    throw std::runtime_error("Not all rows are written to " + FileName);
+  if (Fmt == Format::PNG) {
+    flushBlocks(true);
+    writeChunk("IEND", nullptr, 0);
+  }
+  Out.flush();
+  if (!Out)
+    throw std::runtime_error("Can't write " + FileName);
+}
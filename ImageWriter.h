@@ -0,0 +1,76 @@
+#ifndef FRACGEN_IMAGE_WRITER_H_DEFINED__
+#define FRACGEN_IMAGE_WRITER_H_DEFINED__
+
+#include "Image.h"
+
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <cstdint>
+
+// Writer of RGB images which doesn't need any external library.
+// Rows are appended from top to bottom, so image doesn't have to be
+// kept in memory as a whole. Format is chosen by extension of file name:
+// binary PPM for .ppm, PNG for everything else. PNG data isn't
+// compressed (deflate stored blocks) since there is no zlib.
+// Image can also be appended to already open stream, e.g. to write
+// several PPM frames one after another.
+// Throws std::runtime_error if file can't be written.
+class ImageWriter {
+public:
+  enum class Format { PNG, PPM };
+
+private:
+  std::ofstream File;
+  std::ostream &Out;
+  std::string FileName;
+  Format Fmt;
+  unsigned Width;
+  unsigned Height;
+  unsigned Depth;
+  unsigned RowsWritten = 0;
+
+  // Bytes of PNG image data not yet put into deflate block.
+  std::vector<std::uint8_t> Pending;
+  std::uint32_t Adler = 1;
+  bool StreamStarted = false;
+  // Row in file byte order (samples are big-endian in both formats).
+  std::vector<std::uint8_t> RowBuf;
+
+  void writeHeader();
+  void writeBytes(const std::uint8_t *Data, std::size_t Size);
+  void writeChunk(const char *Type, const std::uint8_t *Data, std::size_t Size);
+  void flushBlocks(bool Final);
+  void writeEncodedRow();
+
+public:
+  static Format getFormat(const std::string &FileName);
+
+  // Depth is 8 or 16 bits per channel.
+  ImageWriter(const std::string &FileName, unsigned Width, unsigned Height, unsigned Depth);
+  // Name is used only in error messages.
+  ImageWriter(std::ostream &Out, const std::string &Name, Format Fmt, unsigned Width,
+              unsigned Height, unsigned Depth);
+
+  ImageWriter(const ImageWriter &) = delete;
+  ImageWriter &operator=(const ImageWriter &) = delete;
+
+  // Row holds 3 * Width samples of depth given to constructor.
+  void writeRow(const std::uint8_t *Row);
+  void writeRow(const std::uint16_t *Row);
+
+  // Must be called after last row.
+  void finish();
+};
+
+template<typename SampleTy>
+void writeImage(const RGBImage<SampleTy> &Img, const std::string &FileName) {
+  ImageWriter Writer(FileName, Img.getWidth(), Img.getHeight(), Img.Depth);
+  for (unsigned Y = 0; Y < Img.getHeight(); ++Y)
+    Writer.writeRow(Img.getRow(Y));
+  Writer.finish();
+}
+
+#endif
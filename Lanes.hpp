@@ -0,0 +1,666 @@
+#ifndef FRACGEN_LANES_HPP_DEFINED__
+#define FRACGEN_LANES_HPP_DEFINED__
+
+#include "Types.h"
+
+#include <complex>
+#include <limits>
+#include <type_traits>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Several complex numbers processed in lockstep. Real and imaginary
+// parts are kept in separate arrays (struct of arrays) so every
+// operation is a plain loop over lanes that compiler turns into
+// AVX2/AVX-512 instructions with -march=native. Lanes are double or
+// float; the latter fit twice as many into vector register.
+
+#if defined(__AVX512F__)
+constexpr unsigned VectorBytes = 64;
+#elif defined(__AVX__)
+constexpr unsigned VectorBytes = 32;
+#else
+constexpr unsigned VectorBytes = 16;
+#endif
+
+// Number of lanes of type T that fill vector register.
+template<typename T>
+constexpr unsigned DefaultLanes = VectorBytes / sizeof(T);
+
+template<unsigned N, typename T = FloatType>
+struct RealLanes {
+  alignas(N * sizeof(T)) T V[N];
+
+  T operator[](unsigned Idx) const {
+    return V[Idx];
+  }
+};
+
+// Result of comparison of lanes.
+template<unsigned N>
+struct LaneMask {
+  bool V[N];
+
+  bool operator[](unsigned Idx) const {
+    return V[Idx];
+  }
+};
+
+namespace LanesMath {
+
+static inline std::uint64_t toBits(double X) {
+  std::uint64_t B;
+  std::memcpy(&B, &X, sizeof(B));
+  return B;
+}
+
+static inline double fromBits(std::uint64_t B) {
+  double X;
+  std::memcpy(&X, &B, sizeof(X));
+  return X;
+}
+
+static inline std::uint32_t toBitsF(float X) {
+  std::uint32_t B;
+  std::memcpy(&B, &X, sizeof(B));
+  return B;
+}
+
+static inline float fromBitsF(std::uint32_t B) {
+  float X;
+  std::memcpy(&X, &B, sizeof(X));
+  return X;
+}
+
+// std::floor isn't vectorized unless traps are disabled, so it is
+// done by rounding with magic constant. Valid for |X| < 2^51.
+static inline double floor(double X) {
+  constexpr double Magic = 6755399441055744.0;
+  double R = (X + Magic) - Magic;
+  return R > X ? R - 1.0 : R;
+}
+
+// Valid for |X| < 2^22.
+static inline float floor(float X) {
+  constexpr float Magic = 12582912.0f;
+  float R = (X + Magic) - Magic;
+  return R > X ? R - 1.0f : R;
+}
+
+// Kernels below are branch-free versions of Cephes routines.
+// Every lane takes the same path so loops are vectorized.
+
+template<unsigned N>
+inline void exp(const double *X, double *Res) {
+  constexpr double MaxLog = 7.09782712893383996843e2;
+  constexpr double MinLog = -7.45133219101941108420e2;
+  for (unsigned k = 0; k < N; ++k) {
+    double Arg = X[k];
+    double V = Arg > MaxLog ? MaxLog : (Arg < MinLog ? MinLog : Arg);
+
+    // exp(x) = 2^n * exp(r), |r| <= ln(2) / 2.
+    double Pw = floor(1.4426950408889634073599 * V + 0.5);
+    V -= Pw * 6.93145751953125e-1;
+    V -= Pw * 1.42860682030941723212e-6;
+
+    double VV = V * V;
+    double P = V * ((1.26177193074810590878e-4 * VV + 3.02994407707441961300e-2) * VV +
+                    9.99999999999999999910e-1);
+    double Q = ((3.00198505138664455042e-6 * VV + 2.52448340349684104192e-3) * VV +
+                2.27265548208155028766e-1) * VV + 2.00000000000000000009e0;
+    V = 1.0 + 2.0 * (P / (Q - P));
+
+    // 2^n is built from bits in two halves, so both of them
+    // are normal numbers even if result overflows or is subnormal.
+    double Pw1 = floor(0.5 * Pw);
+    double Pw2 = Pw - Pw1;
+    std::uint64_t Exp1 = toBits(Pw1 + 1023.0 + 4503599627370496.0) & 0x7ff;
+    std::uint64_t Exp2 = toBits(Pw2 + 1023.0 + 4503599627370496.0) & 0x7ff;
+    V = V * fromBits(Exp1 << 52) * fromBits(Exp2 << 52);
+
+    Res[k] = Arg > MaxLog ? std::numeric_limits<double>::infinity() :
+      (Arg < MinLog ? 0.0 : V);
+  }
+}
+
+// Both functions at once: they share exponent.
+template<unsigned N>
+inline void sinhcosh(const double *X, double *Sinh, double *Cosh) {
+  alignas(N * sizeof(double)) double Abs[N], E[N];
+  for (unsigned k = 0; k < N; ++k)
+    Abs[k] = std::abs(X[k]);
+  exp<N>(Abs, E);
+
+  for (unsigned k = 0; k < N; ++k) {
+    double EInv = 1.0 / E[k];
+    Cosh[k] = 0.5 * (E[k] + EInv);
+
+    // Difference of exponents loses precision near zero.
+    double Z = X[k] * X[k];
+    double P = ((-7.89474443963537015605e-1 * Z - 1.63725857525983828727e2) * Z -
+                1.15614435765005216044e4) * Z - 3.51754964808151394800e5;
+    double Q = ((Z - 2.77711081420602794433e2) * Z + 3.61578279834431989373e4) * Z -
+      2.11052978884890840399e6;
+    double Small = X[k] + X[k] * Z * (P / Q);
+    double Big = 0.5 * (E[k] - EInv);
+    Sinh[k] = Abs[k] <= 1.0 ? Small : (X[k] < 0.0 ? -Big : Big);
+  }
+}
+
+template<unsigned N>
+inline void log(const double *X, double *Res) {
+  constexpr double Sqrth = 0.70710678118654752440;
+  for (unsigned k = 0; k < N; ++k) {
+    double Arg = X[k];
+    // Subnormals are scaled up to normal range first.
+    bool Small = Arg < std::numeric_limits<double>::min();
+    double V = Small ? Arg * 18014398509481984.0 : Arg;
+
+    // V = M * 2^E, M in [0.5, 1).
+    std::uint64_t B = toBits(V);
+    double E = fromBits(((B >> 52) & 0x7ff) | 0x4330000000000000ULL) - 4503599627370496.0 -
+      (Small ? 1022.0 + 54.0 : 1022.0);
+    double M = fromBits((B & 0x000fffffffffffffULL) | 0x3fe0000000000000ULL);
+
+    bool Lo = M < Sqrth;
+    E = Lo ? E - 1.0 : E;
+    M = Lo ? M + M - 1.0 : M - 1.0;
+
+    double Z = M * M;
+    double P = ((((1.01875663804580931796e-4 * M + 4.97494994976747001425e-1) * M +
+                  4.70579119878881725854e0) * M + 1.44989225341610930846e1) * M +
+                1.79368678507819816313e1) * M + 7.70838733755885391666e0;
+    double Q = ((((M + 1.12873587189167450590e1) * M + 4.52279145837532221105e1) * M +
+                 8.29875266912776603211e1) * M + 7.11544750618563894466e1) * M +
+      2.31251620126765340583e1;
+    double Y = M * (Z * P / Q);
+    Y -= E * 2.121944400546905827679e-4;
+    Y -= 0.5 * Z;
+    V = M + Y + E * 0.693359375;
+
+    Res[k] = Arg > 0.0 ?
+      (Arg == std::numeric_limits<double>::infinity() ? Arg : V) :
+      (Arg == 0.0 ? -std::numeric_limits<double>::infinity() :
+       std::numeric_limits<double>::quiet_NaN());
+  }
+}
+
+// Beyond this reduction by pi/4 loses precision, such lanes use std.
+constexpr double SinCosLimit = 1.073741824e9;
+
+template<unsigned N>
+inline void sincos(const double *X, double *Sin, double *Cos) {
+  int Huge = 0;
+  for (unsigned k = 0; k < N; ++k) {
+    double V = std::abs(X[k]);
+    Huge |= V > SinCosLimit ? 1 : 0;
+
+    // Octant of argument. Odd octants are moved to next one.
+    double Oct = floor(V * 1.27323954473516268615);
+    Oct += Oct - 2.0 * floor(0.5 * Oct);
+    double J = Oct - 8.0 * floor(0.125 * Oct);
+
+    double Z = ((V - Oct * 7.85398125648498535156e-1) - Oct * 3.77489470793079817668e-8) -
+      Oct * 2.69515142907905952645e-15;
+    double ZZ = Z * Z;
+    double SinPoly = Z + Z * ZZ *
+      (((((1.58962301576546568060e-10 * ZZ - 2.50507477628578072866e-8) * ZZ +
+          2.75573136213857245213e-6) * ZZ - 1.98412698295895385996e-4) * ZZ +
+        8.33333333332211858878e-3) * ZZ - 1.66666666666666307295e-1);
+    double CosPoly = 1.0 - 0.5 * ZZ + ZZ * ZZ *
+      (((((-1.13585365213876817300e-11 * ZZ + 2.08757008419747316778e-9) * ZZ -
+          2.75573141792967388112e-7) * ZZ + 2.48015872888517045348e-5) * ZZ -
+        1.38888888888730564116e-3) * ZZ + 4.16666666666665929218e-2);
+
+    bool Swap = J == 2.0 || J == 6.0;
+    double S = Swap ? CosPoly : SinPoly;
+    double C = Swap ? SinPoly : CosPoly;
+    S = (J >= 4.0) != (X[k] < 0.0) ? -S : S;
+    C = J == 2.0 || J == 4.0 ? -C : C;
+    Sin[k] = S;
+    Cos[k] = C;
+  }
+
+  if (Huge)
+    for (unsigned k = 0; k < N; ++k)
+      if (std::abs(X[k]) > SinCosLimit) {
+        Sin[k] = std::sin(X[k]);
+        Cos[k] = std::cos(X[k]);
+      }
+}
+
+template<unsigned N>
+inline void atan2(const double *Y, const double *X, double *Res) {
+  constexpr double Pi = 3.14159265358979323846;
+  constexpr double MoreBits = 6.123233995736765886130e-17;
+  for (unsigned k = 0; k < N; ++k) {
+    double T = Y[k] / X[k];
+    double V = std::abs(T);
+
+    // Reduce argument of atan to [0, 0.66].
+    bool Big = V > 2.41421356237309504880;
+    bool Mid = !Big && V > 0.66;
+    double Base = Big ? Pi / 2 : (Mid ? Pi / 4 : 0.0);
+    double Extra = Big ? MoreBits : (Mid ? 0.5 * MoreBits : 0.0);
+    V = Big ? -1.0 / V : (Mid ? (V - 1.0) / (V + 1.0) : V);
+
+    double Z = V * V;
+    double P = ((((-8.750608600031904122785e-1 * Z - 1.615753718733365076637e1) * Z -
+                  7.500855792314704667340e1) * Z - 1.228866684490136173410e2) * Z -
+                6.485021904942025371773e1);
+    double Q = ((((Z + 2.485846490142306297962e1) * Z + 1.650270098316988542046e2) * Z +
+                 4.328810604912902668951e2) * Z + 4.853903996359136964868e2) * Z +
+      1.945506571482613964425e2;
+    V = Base + (V * (Z * P / Q) + V + Extra);
+    V = T < 0.0 ? -V : V;
+
+    // Quadrant of (X, Y). Sign of zero matters on branch cut.
+    double Half = std::signbit(Y[k]) ? -Pi / 2 : Pi / 2;
+    V = X[k] < 0.0 ? V + 2.0 * Half : V;
+    Res[k] = X[k] == 0.0 ? (Y[k] == 0.0 ? Y[k] : Half) : V;
+  }
+}
+
+// Float versions of kernels above, from single precision Cephes
+// routines. Structure is the same.
+
+template<unsigned N>
+inline void exp(const float *X, float *Res) {
+  constexpr float MaxLog = 88.72283905206835f;
+  constexpr float MinLog = -103.278929903431851103f;
+  for (unsigned k = 0; k < N; ++k) {
+    float Arg = X[k];
+    float V = Arg > MaxLog ? MaxLog : (Arg < MinLog ? MinLog : Arg);
+
+    float Pw = floor(1.44269504088896341f * V + 0.5f);
+    V -= Pw * 0.693359375f;
+    V -= Pw * -2.12194440e-4f;
+
+    float VV = V * V;
+    V = ((((((1.9875691500e-4f * V + 1.3981999507e-3f) * V + 8.3334519073e-3f) * V +
+            4.1665795894e-2f) * V + 1.6666665459e-1f) * V + 5.0000001201e-1f) * VV + V) + 1.0f;
+
+    float Pw1 = floor(0.5f * Pw);
+    float Pw2 = Pw - Pw1;
+    std::uint32_t Exp1 = toBitsF(Pw1 + 127.0f + 8388608.0f) & 0xff;
+    std::uint32_t Exp2 = toBitsF(Pw2 + 127.0f + 8388608.0f) & 0xff;
+    V = V * fromBitsF(Exp1 << 23) * fromBitsF(Exp2 << 23);
+
+    Res[k] = Arg > MaxLog ? std::numeric_limits<float>::infinity() :
+      (Arg < MinLog ? 0.0f : V);
+  }
+}
+
+template<unsigned N>
+inline void sinhcosh(const float *X, float *Sinh, float *Cosh) {
+  alignas(N * sizeof(float)) float Abs[N], E[N];
+  for (unsigned k = 0; k < N; ++k)
+    Abs[k] = std::abs(X[k]);
+  exp<N>(Abs, E);
+
+  for (unsigned k = 0; k < N; ++k) {
+    float EInv = 1.0f / E[k];
+    Cosh[k] = 0.5f * (E[k] + EInv);
+
+    float Z = X[k] * X[k];
+    float Small = ((2.03721912945e-4f * Z + 8.33028376239e-3f) * Z + 1.66667160211e-1f) * Z *
+      X[k] + X[k];
+    float Big = 0.5f * (E[k] - EInv);
+    Sinh[k] = Abs[k] <= 1.0f ? Small : (X[k] < 0.0f ? -Big : Big);
+  }
+}
+
+template<unsigned N>
+inline void log(const float *X, float *Res) {
+  constexpr float Sqrth = 0.707106781186547524f;
+  for (unsigned k = 0; k < N; ++k) {
+    float Arg = X[k];
+    bool Small = Arg < std::numeric_limits<float>::min();
+    float V = Small ? Arg * 33554432.0f : Arg;
+
+    std::uint32_t B = toBitsF(V);
+    float E = fromBitsF(((B >> 23) & 0xff) | 0x4b000000U) - 8388608.0f -
+      (Small ? 126.0f + 25.0f : 126.0f);
+    float M = fromBitsF((B & 0x007fffffU) | 0x3f000000U);
+
+    bool Lo = M < Sqrth;
+    E = Lo ? E - 1.0f : E;
+    M = Lo ? M + M - 1.0f : M - 1.0f;
+
+    float Z = M * M;
+    float Y = ((((((((7.0376836292e-2f * M - 1.1514610310e-1f) * M + 1.1676998740e-1f) * M -
+                    1.2420140846e-1f) * M + 1.4249322787e-1f) * M - 1.6668057665e-1f) * M +
+                 2.0000714765e-1f) * M - 2.4999993993e-1f) * M + 3.3333331174e-1f) * M * Z;
+    Y -= E * 2.12194440e-4f;
+    Y -= 0.5f * Z;
+    V = M + Y + E * 0.693359375f;
+
+    Res[k] = Arg > 0.0f ?
+      (Arg == std::numeric_limits<float>::infinity() ? Arg : V) :
+      (Arg == 0.0f ? -std::numeric_limits<float>::infinity() :
+       std::numeric_limits<float>::quiet_NaN());
+  }
+}
+
+constexpr float SinCosLimitF = 8192.0f;
+
+template<unsigned N>
+inline void sincos(const float *X, float *Sin, float *Cos) {
+  int Huge = 0;
+  for (unsigned k = 0; k < N; ++k) {
+    float V = std::abs(X[k]);
+    Huge |= V > SinCosLimitF ? 1 : 0;
+
+    float Oct = floor(V * 1.27323954473516f);
+    Oct += Oct - 2.0f * floor(0.5f * Oct);
+    float J = Oct - 8.0f * floor(0.125f * Oct);
+
+    float Z = ((V - Oct * 0.78515625f) - Oct * 2.4187564849853515625e-4f) -
+      Oct * 3.77489497744594108e-8f;
+    float ZZ = Z * Z;
+    float SinPoly = ((-1.9515295891e-4f * ZZ + 8.3321608736e-3f) * ZZ - 1.6666654611e-1f) *
+      ZZ * Z + Z;
+    float CosPoly = ((2.443315711809948e-5f * ZZ - 1.388731625493765e-3f) * ZZ +
+                     4.166664568298827e-2f) * ZZ * ZZ - 0.5f * ZZ + 1.0f;
+
+    bool Swap = J == 2.0f || J == 6.0f;
+    float S = Swap ? CosPoly : SinPoly;
+    float C = Swap ? SinPoly : CosPoly;
+    S = (J >= 4.0f) != (X[k] < 0.0f) ? -S : S;
+    C = J == 2.0f || J == 4.0f ? -C : C;
+    Sin[k] = S;
+    Cos[k] = C;
+  }
+
+  if (Huge)
+    for (unsigned k = 0; k < N; ++k)
+      if (std::abs(X[k]) > SinCosLimitF) {
+        Sin[k] = std::sin(X[k]);
+        Cos[k] = std::cos(X[k]);
+      }
+}
+
+template<unsigned N>
+inline void atan2(const float *Y, const float *X, float *Res) {
+  constexpr float Pi = 3.14159265358979323846f;
+  for (unsigned k = 0; k < N; ++k) {
+    float T = Y[k] / X[k];
+    float V = std::abs(T);
+
+    // Reduce argument of atan to [0, tan(pi / 8)].
+    bool Big = V > 2.414213562373095f;
+    bool Mid = !Big && V > 0.4142135623730950f;
+    float Base = Big ? Pi / 2 : (Mid ? Pi / 4 : 0.0f);
+    V = Big ? -1.0f / V : (Mid ? (V - 1.0f) / (V + 1.0f) : V);
+
+    float Z = V * V;
+    V = Base + ((((8.05374449538e-2f * Z - 1.38776856032e-1f) * Z + 1.99777106478e-1f) * Z -
+                 3.33329491539e-1f) * Z * V + V);
+    V = T < 0.0f ? -V : V;
+
+    float Half = std::signbit(Y[k]) ? -Pi / 2 : Pi / 2;
+    V = X[k] < 0.0f ? V + 2.0f * Half : V;
+    Res[k] = X[k] == 0.0f ? (Y[k] == 0.0f ? Y[k] : Half) : V;
+  }
+}
+
+} // namespace LanesMath
+
+template<unsigned N, typename T = FloatType>
+class ComplexLanes {
+  using ScalarTy = std::complex<T>;
+  using RealTy = RealLanes<N, T>;
+  static constexpr std::size_t Align = N * sizeof(T);
+
+  template<typename OpTy>
+  static ComplexLanes map(const ComplexLanes &Z, OpTy Op) {
+    ComplexLanes Res;
+    for (unsigned k = 0; k < N; ++k)
+      Res.set(k, Op(Z[k]));
+    return Res;
+  }
+
+public:
+  alignas(Align) T Re[N];
+  alignas(Align) T Im[N];
+
+  static constexpr unsigned Width = N;
+
+  ComplexLanes() = default;
+
+  // Broadcasts scalar to all lanes. Implicit so constants of
+  // expression can be mixed with lanes.
+  ComplexLanes(ValType V) {
+    for (unsigned k = 0; k < N; ++k) {
+      Re[k] = static_cast<T>(V.real());
+      Im[k] = static_cast<T>(V.imag());
+    }
+  }
+
+  ComplexLanes(FloatType V): ComplexLanes(ValType(V)) {}
+
+  explicit ComplexLanes(const ValType *Vals) {
+    for (unsigned k = 0; k < N; ++k) {
+      Re[k] = static_cast<T>(Vals[k].real());
+      Im[k] = static_cast<T>(Vals[k].imag());
+    }
+  }
+
+  ScalarTy operator[](unsigned Idx) const {
+    return ScalarTy(Re[Idx], Im[Idx]);
+  }
+
+  void set(unsigned Idx, ScalarTy V) {
+    Re[Idx] = V.real();
+    Im[Idx] = V.imag();
+  }
+
+  bool isNaN(unsigned Idx) const {
+    return std::isnan(Re[Idx]) || std::isnan(Im[Idx]);
+  }
+
+  // Arithmetic {{
+
+  friend ComplexLanes operator+(const ComplexLanes &A) {
+    return A;
+  }
+
+  friend ComplexLanes operator-(const ComplexLanes &A) {
+    ComplexLanes Res;
+    for (unsigned k = 0; k < N; ++k) {
+      Res.Re[k] = -A.Re[k];
+      Res.Im[k] = -A.Im[k];
+    }
+    return Res;
+  }
+
+  friend ComplexLanes operator+(const ComplexLanes &A, const ComplexLanes &B) {
+    ComplexLanes Res;
+    for (unsigned k = 0; k < N; ++k) {
+      Res.Re[k] = A.Re[k] + B.Re[k];
+      Res.Im[k] = A.Im[k] + B.Im[k];
+    }
+    return Res;
+  }
+
+  friend ComplexLanes operator-(const ComplexLanes &A, const ComplexLanes &B) {
+    ComplexLanes Res;
+    for (unsigned k = 0; k < N; ++k) {
+      Res.Re[k] = A.Re[k] - B.Re[k];
+      Res.Im[k] = A.Im[k] - B.Im[k];
+    }
+    return Res;
+  }
+
+  friend ComplexLanes operator*(const ComplexLanes &A, const ComplexLanes &B) {
+    ComplexLanes Res;
+    for (unsigned k = 0; k < N; ++k) {
+      Res.Re[k] = A.Re[k] * B.Re[k] - A.Im[k] * B.Im[k];
+      Res.Im[k] = A.Re[k] * B.Im[k] + A.Im[k] * B.Re[k];
+    }
+    return Res;
+  }
+
+  friend ComplexLanes operator/(const ComplexLanes &A, const ComplexLanes &B) {
+    ComplexLanes Res;
+    for (unsigned k = 0; k < N; ++k) {
+      T Den = B.Re[k] * B.Re[k] + B.Im[k] * B.Im[k];
+      Res.Re[k] = (A.Re[k] * B.Re[k] + A.Im[k] * B.Im[k]) / Den;
+      Res.Im[k] = (A.Im[k] * B.Re[k] - A.Re[k] * B.Im[k]) / Den;
+    }
+    return Res;
+  }
+
+  // }} Arithmetic.
+
+  // Vectorized functions {{
+
+  // |Z| without overflow of squares.
+  friend RealTy abs(const ComplexLanes &Z) {
+    RealTy Res;
+    for (unsigned k = 0; k < N; ++k) {
+      T A = std::abs(Z.Re[k]), B = std::abs(Z.Im[k]);
+      T Max = A > B ? A : B, Min = A > B ? B : A;
+      T Q = Min / Max;
+      Res.V[k] = Max == T(0) ? T(0) : Max * std::sqrt(T(1) + Q * Q);
+    }
+    return Res;
+  }
+
+  friend ComplexLanes sqrt(const ComplexLanes &Z) {
+    RealTy R = abs(Z);
+    ComplexLanes Res;
+    for (unsigned k = 0; k < N; ++k) {
+      T S = std::sqrt(T(0.5) * (R.V[k] + std::abs(Z.Re[k])));
+      T U = S == T(0) ? T(0) : T(0.5) * Z.Im[k] / S;
+      bool Neg = Z.Re[k] < T(0);
+      Res.Re[k] = Neg ? std::abs(U) : S;
+      Res.Im[k] = Neg ? (std::signbit(Z.Im[k]) ? -S : S) : U;
+    }
+    return Res;
+  }
+
+  friend ComplexLanes exp(const ComplexLanes &Z) {
+    alignas(Align) T Mag[N], Sin[N], Cos[N];
+    LanesMath::exp<N>(Z.Re, Mag);
+    LanesMath::sincos<N>(Z.Im, Sin, Cos);
+    ComplexLanes Res;
+    for (unsigned k = 0; k < N; ++k) {
+      Res.Re[k] = Mag[k] * Cos[k];
+      Res.Im[k] = Mag[k] * Sin[k];
+    }
+    return Res;
+  }
+
+  friend ComplexLanes log(const ComplexLanes &Z) {
+    RealTy R = abs(Z);
+    ComplexLanes Res;
+    LanesMath::log<N>(R.V, Res.Re);
+    LanesMath::atan2<N>(Z.Im, Z.Re, Res.Im);
+    return Res;
+  }
+
+  friend ComplexLanes sin(const ComplexLanes &Z) {
+    alignas(Align) T Sin[N], Cos[N], Sinh[N], Cosh[N];
+    LanesMath::sincos<N>(Z.Re, Sin, Cos);
+    LanesMath::sinhcosh<N>(Z.Im, Sinh, Cosh);
+    ComplexLanes Res;
+    for (unsigned k = 0; k < N; ++k) {
+      Res.Re[k] = Sin[k] * Cosh[k];
+      Res.Im[k] = Cos[k] * Sinh[k];
+    }
+    return Res;
+  }
+
+  friend ComplexLanes cos(const ComplexLanes &Z) {
+    alignas(Align) T Sin[N], Cos[N], Sinh[N], Cosh[N];
+    LanesMath::sincos<N>(Z.Re, Sin, Cos);
+    LanesMath::sinhcosh<N>(Z.Im, Sinh, Cosh);
+    ComplexLanes Res;
+    for (unsigned k = 0; k < N; ++k) {
+      Res.Re[k] = Cos[k] * Cosh[k];
+      Res.Im[k] = -Sin[k] * Sinh[k];
+    }
+    return Res;
+  }
+
+  friend ComplexLanes tan(const ComplexLanes &Z) {
+    return sin(Z) / cos(Z);
+  }
+
+  friend ComplexLanes sinh(const ComplexLanes &Z) {
+    alignas(Align) T Sin[N], Cos[N], Sinh[N], Cosh[N];
+    LanesMath::sincos<N>(Z.Im, Sin, Cos);
+    LanesMath::sinhcosh<N>(Z.Re, Sinh, Cosh);
+    ComplexLanes Res;
+    for (unsigned k = 0; k < N; ++k) {
+      Res.Re[k] = Sinh[k] * Cos[k];
+      Res.Im[k] = Cosh[k] * Sin[k];
+    }
+    return Res;
+  }
+
+  friend ComplexLanes cosh(const ComplexLanes &Z) {
+    alignas(Align) T Sin[N], Cos[N], Sinh[N], Cosh[N];
+    LanesMath::sincos<N>(Z.Im, Sin, Cos);
+    LanesMath::sinhcosh<N>(Z.Re, Sinh, Cosh);
+    ComplexLanes Res;
+    for (unsigned k = 0; k < N; ++k) {
+      Res.Re[k] = Cosh[k] * Cos[k];
+      Res.Im[k] = Sinh[k] * Sin[k];
+    }
+    return Res;
+  }
+
+  // Kahan's formula, the one used by C library too.
+  friend ComplexLanes tanh(const ComplexLanes &Z) {
+    alignas(Align) T Sin[N], Cos[N], Sinh[N], Cosh[N];
+    LanesMath::sincos<N>(Z.Im, Sin, Cos);
+    LanesMath::sinhcosh<N>(Z.Re, Sinh, Cosh);
+    ComplexLanes Res;
+    for (unsigned k = 0; k < N; ++k) {
+      T Tan = Sin[k] / Cos[k];
+      T Beta = T(1) + Tan * Tan;
+      T Den = T(1) + Beta * Sinh[k] * Sinh[k];
+      // Far from imaginary axis tanh is +-1 and formula overflows.
+      bool Far = std::abs(Z.Re[k]) > T(22);
+      Res.Re[k] = Far ? (Z.Re[k] < T(0) ? T(-1) : T(1)) : Beta * Cosh[k] * Sinh[k] / Den;
+      Res.Im[k] = Far ? Sin[k] * Cos[k] / (Cosh[k] * Cosh[k]) : Tan / Den;
+    }
+    return Res;
+  }
+
+  // At A = 0 log is -inf and exp(B * log(A)) is NaN, while std::pow
+  // gives 0 for B with positive real part.
+  friend ComplexLanes pow(const ComplexLanes &A, const ComplexLanes &B) {
+    ComplexLanes Res = exp(B * log(A));
+    for (unsigned k = 0; k < N; ++k) {
+      bool Zero = A.Re[k] == T(0) && A.Im[k] == T(0) && B.Re[k] > T(0);
+      Res.Re[k] = Zero ? T(0) : Res.Re[k];
+      Res.Im[k] = Zero ? T(0) : Res.Im[k];
+    }
+    return Res;
+  }
+
+  // }} Vectorized functions.
+
+  // Lane by lane fallback for the rest {{
+
+#define FRACGEN_LANES_STD_FUNC(Fn)                                      \
+  friend ComplexLanes Fn(const ComplexLanes &Z) {                       \
+    return map(Z, [](ScalarTy V) { return std::Fn(V); });               \
+  }
+  FRACGEN_LANES_STD_FUNC(asin)
+  FRACGEN_LANES_STD_FUNC(acos)
+  FRACGEN_LANES_STD_FUNC(atan)
+  FRACGEN_LANES_STD_FUNC(asinh)
+  FRACGEN_LANES_STD_FUNC(acosh)
+  FRACGEN_LANES_STD_FUNC(atanh)
+#undef FRACGEN_LANES_STD_FUNC
+
+  // }} Lane by lane fallback.
+};
+
+#endif
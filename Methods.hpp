@@ -1,27 +1,91 @@
 #ifndef FRACGEN_ITER_METHODS_DEFINED__
 #define FRACGEN_ITER_METHODS_DEFINED__
 
+#include "Color.h"
 #include "Config.h"
+#include "Deep.hpp"
+#include "Lanes.hpp"
 #include "Support.hpp"
 #include "TypeHelpers.hpp"
 #include "Types.h"
 
+#include <algorithm>
+#include <chrono>
 #include <functional>
-#include <random>
+#include <tuple>
 #include <type_traits>
 #include <utility>
 
 #include <cmath>
+#include <cstdint>
+
+// Point of iteration together with value of function at it.
+// Methods get last UsedPts of them, so every point is evaluated
+// only once: by convergence test of getPointIndexN. Derivative is
+// set only if it is calculated together with value (see IsFusedV).
+struct FnPoint {
+  ValType Pt;
+  ValType Val;
+  ValType Diff = 0.0;
+};
+
+// Methods that need derivative of function are marked with UsesDiff.
+template<typename Method, typename = void>
+struct UsesDiff : std::false_type {};
+
+template<typename Method>
+struct UsesDiff<Method, std::void_t<decltype(Method::UsesDiff)>> :
+  std::bool_constant<Method::UsesDiff> {};
+
+template<typename Method>
+constexpr bool UsesDiffV = UsesDiff<Method>::value;
+
+// Compiled expression can provide static withDiff(Pt) that returns
+// pair of value and derivative sharing common subexpressions.
+template<typename FnTy, typename = void>
+struct HasWithDiff : std::false_type {};
+
+template<typename FnTy>
+struct HasWithDiff<FnTy, std::void_t<decltype(FnTy::withDiff(ValType()))>> : std::true_type {};
+
+template<typename FnTy>
+constexpr bool HasWithDiffV = HasWithDiff<FnTy>::value;
+
+// Derivative is evaluated together with value at every point.
+template<typename Method, typename FnTy>
+constexpr bool IsFusedV = UsesDiffV<Method> && HasWithDiffV<FnTy>;
+
+template<typename Method, typename FnTy>
+static FnPoint evalPoint(FnTy Fn, ValType Pt) {
+  if constexpr (IsFusedV<Method, FnTy>) {
+    auto [Val, Diff] = Fn.withDiff(Pt);
+    return {Pt, Val, Diff};
+  } else {
+    return {Pt, Fn(Pt)};
+  }
+}
+
+// Methods that use one point and have no state can also provide
+// static step(Fn, Pt, Val) that works both for ValType and ComplexLanes,
+// Val is Fn(Pt). Such methods are marked with Batchable and can be run
+// on several points in lockstep by getPointIndexBatch. If they use
+// derivative, step(Fn, Pt, Val, Diff) takes it already calculated.
 
 struct CalcNextContractor {
   static constexpr IdxType UsedPts = 1;
+  static constexpr bool Batchable = true;
 
   template<typename FnTy, typename PtCont>
   CalcNextContractor(FnTy Fn, const PtCont &Pts) {}
 
+  template<typename FnTy, typename T>
+  static T step(FnTy Fn, const T &Pt, const T &Val) {
+    return Val;
+  }
+
   template<typename FnTy, typename NormTy, typename PtCont>
   ValType get(FnTy Fn, NormTy Norm, const PtCont &Pts) {
-    return Fn(Pts.front());
+    return step(Fn, Pts.front().Pt, Pts.front().Val);
   }
 
   template<typename FnTy, typename PtCont>
@@ -36,7 +100,7 @@ struct CalcNextInvertedContractor {
 
   template<typename FnTy, typename NormTy, typename PtCont>
   ValType get(FnTy Fn, NormTy Norm, const PtCont &Pts) {
-    return 1.0 / Fn(Pts.front());
+    return 1.0 / Pts.front().Val;
   }
 
   template<typename FnTy, typename PtCont>
@@ -51,7 +115,7 @@ struct CalcNextLogContractor {
 
   template<typename FnTy, typename NormTy, typename PtCont>
   ValType get(FnTy Fn, NormTy Norm, const PtCont &Pts) {
-    return std::log(Fn(Pts.front()));
+    return std::log(Pts.front().Val);
   }
 
   template<typename FnTy, typename PtCont>
@@ -60,15 +124,29 @@ struct CalcNextLogContractor {
 
 struct CalcNextNewton {
   static constexpr IdxType UsedPts = 1;
+  static constexpr bool Batchable = true;
+  static constexpr bool UsesDiff = true;
 
   template<typename FnTy, typename PtCont>
   CalcNextNewton(FnTy Fn, const PtCont &Pts) {}
 
+  template<typename FnTy, typename T>
+  static T step(FnTy Fn, const T &Pt, const T &Val, const T &Diff) {
+    return Pt - Val / Diff;
+  }
+
+  template<typename FnTy, typename T>
+  static T step(FnTy Fn, const T &Pt, const T &Val) {
+    return step(Fn, Pt, Val, T(Fn.diff(Pt)));
+  }
+
   template<typename FnTy, typename NormTy, typename PtCont>
   ValType get(FnTy Fn, NormTy Norm, const PtCont &Pts) {
-    ValType FnRes = Fn(Pts.front());
-    ValType DiffRes = Fn.diff(Pts.front());
-    return Pts.front() - FnRes / DiffRes;
+    const FnPoint &P0 = Pts.front();
+    if constexpr (HasWithDiffV<FnTy>)
+      return step(Fn, P0.Pt, P0.Val, P0.Diff);
+    else
+      return step(Fn, P0.Pt, P0.Val);
   }
 
   template<typename FnTy, typename PtCont>
@@ -85,12 +163,12 @@ private:
 public:
   template<typename FnTy, typename PtCont>
   CalcNextChord(FnTy Fn, const PtCont &Pts):
-    InitPt(Pts.front()), FnInit(Fn(InitPt)) {}
+    InitPt(Pts.front().Pt), FnInit(Pts.front().Val) {}
 
   template<typename FnTy, typename NormTy, typename PtCont>
   ValType get(FnTy Fn, NormTy Norm, const PtCont &Pts) {
-    ValType F0 = Fn(Pts.front());
-    return Pts.front() - FnInit * (InitPt - Pts.front()) / (FnInit - F0);
+    const FnPoint &P0 = Pts.front();
+    return P0.Pt - FnInit * (InitPt - P0.Pt) / (FnInit - P0.Val);
   }
 
   template<typename FnTy, typename PtCont>
@@ -100,15 +178,20 @@ public:
 // Steffensen's method. Helper for bootstrap stages.
 struct CalcNextSteffensen {
   static constexpr IdxType UsedPts = 1;
+  static constexpr bool Batchable = true;
 
   template<typename FnTy, typename PtCont>
   CalcNextSteffensen(FnTy Fn, const PtCont &Pts) {}
 
+  template<typename FnTy, typename T>
+  static T step(FnTy Fn, const T &Pt, const T &Val) {
+    T Tmp2 = Fn(Pt + Val);
+    return Pt - (Val * Val) / (Tmp2 - Val);
+  }
+
   template<typename FnTy, typename NormTy, typename PtCont>
   ValType get(FnTy Fn, NormTy Norm, const PtCont &Pts) {
-    ValType Tmp = Fn(Pts.front());
-    ValType Tmp2 = Fn(Pts.front() + Tmp);
-    return Pts.front() - (Tmp * Tmp) / (Tmp2 - Tmp);
+    return step(Fn, Pts.front().Pt, Pts.front().Val);
   }
 
   template<typename FnTy, typename PtCont>
@@ -156,15 +239,15 @@ public:
   template<typename FnTy, typename PtCont>
   CalcNextSidi(FnTy Fn, const PtCont &Pts) {
     for (IdxType i = 0; i < PNum; ++i)
-      DW[0][i] = Fn(Pts[i]);
+      DW[0][i] = Pts[i].Val;
 
     for (IdxType i = 1; i < PNum; ++i)
       for (IdxType j = i; j < PNum; ++j) {
-        DW[i][j] = (DW[i - 1][j] - DW[i - 1][j - 1]) / (Pts[j] - Pts[j - i]);
+        DW[i][j] = (DW[i - 1][j] - DW[i - 1][j - 1]) / (Pts[j].Pt - Pts[j - i].Pt);
       }
 
     for (IdxType i = 0; i < Degree; ++i)
-      Diffs[i] = Pts[Degree] - Pts[i];
+      Diffs[i] = Pts[Degree].Pt - Pts[i].Pt;
   }
 
   template<typename FnTy, typename NormTy, typename PtCont>
@@ -189,7 +272,7 @@ public:
       Drv += Last;
     }
 
-    return Pts[Degree] + DW[0][Cur] / Drv;
+    return Pts[Degree].Pt + DW[0][Cur] / Drv;
   }
 
   template<typename FnTy, typename PtCont>
@@ -197,11 +280,11 @@ public:
     advanceDWIdx();
 
     for (IdxType i = 0; i < Degree; ++i)
-      Diffs[i] = Pts[Degree] - Pts[i];
+      Diffs[i] = Pts[Degree].Pt - Pts[i].Pt;
 
     // Renew table.
     // Just update one last column.
-    DW[0][getDWIdx(Degree)] = Fn(Pts[Degree]);
+    DW[0][getDWIdx(Degree)] = Pts[Degree].Val;
     for (IdxType j = 1; j < PNum; ++j) {
       DW[j][getDWIdx(Degree)] =
         (DW[j - 1][getDWIdx(Degree)] - DW[j - 1][getDWIdx(Degree - j)]) /
@@ -241,15 +324,15 @@ public:
   template<typename FnTy, typename PtCont>
   CalcNextSidiErroneus(FnTy Fn, const PtCont &Pts) {
     for (IdxType i = 0; i < PNum; ++i)
-      DW[0][i] = Fn(Pts[i]);
+      DW[0][i] = Pts[i].Val;
 
     for (IdxType i = 1; i < PNum; ++i)
       for (IdxType j = i; j < PNum; ++j) {
-        DW[i][j] = (DW[i - 1][j] - DW[i - 1][j - 1]) / (Pts[j] - Pts[j - i]);
+        DW[i][j] = (DW[i - 1][j] - DW[i - 1][j - 1]) / (Pts[j].Pt - Pts[j - i].Pt);
       }
 
     for (IdxType i = 0; i < Degree; ++i)
-      Diffs[i] = Pts[Degree] - Pts[i];
+      Diffs[i] = Pts[Degree].Pt - Pts[i].Pt;
   }
 
   template<typename FnTy, typename NormTy, typename PtCont>
@@ -260,11 +343,11 @@ public:
     ValType Drv = Last;
     for (IdxType j = Degree - 1; j > 0; --j) {
       Drv *= Diffs[j - 1];
-      Last = DW[j][getDWIdx(j)] + Last * Pts[j];
+      Last = DW[j][getDWIdx(j)] + Last * Pts[j].Pt;
       Drv += Last;
     }
 
-    return Pts[Degree] + DW[0][Cur] / Drv;
+    return Pts[Degree].Pt + DW[0][Cur] / Drv;
   }
 
   template<typename FnTy, typename PtCont>
@@ -273,11 +356,11 @@ public:
 
     // Renew table.
     // Just update one last column.
-    DW[0][getDWIdx(Degree)] = Fn(Pts[Degree]);
+    DW[0][getDWIdx(Degree)] = Pts[Degree].Val;
     for (IdxType j = 1; j < PNum; ++j) {
       DW[j][getDWIdx(Degree + j)] =
         (DW[j - 1][getDWIdx(Degree + j)] - DW[j - 1][getDWIdx(Degree + j - 1)]) /
-        (Pts[Degree] - Pts[Degree - j]);
+        (Pts[Degree].Pt - Pts[Degree - j].Pt);
     }
   }
 };
@@ -290,13 +373,13 @@ struct CalcNextMuller {
 
   template<typename FnTy, typename NormTy, typename PtCont>
   ValType get(FnTy Fn, NormTy Norm, const PtCont &Pts) {
-    ValType P0 = Pts[0];
-    ValType P1 = Pts[1];
-    ValType P2 = Pts[2];
+    ValType P0 = Pts[0].Pt;
+    ValType P1 = Pts[1].Pt;
+    ValType P2 = Pts[2].Pt;
 
-    ValType F0 = Fn(P0);
-    ValType F1 = Fn(P1);
-    ValType F2 = Fn(P2);
+    ValType F0 = Pts[0].Val;
+    ValType F1 = Pts[1].Val;
+    ValType F2 = Pts[2].Val;
 
     ValType F21 = (F2 - F1) / (P2 - P1);
     ValType F20 = (F2 - F0) / (P2 - P0);
@@ -313,6 +396,16 @@ struct CalcNextMuller {
   void update(FnTy Fn, const PtCont &Pts) {}
 };
 
+// Methods with internal state that should differ from point to point
+// (e.g. random generators) take per-point seed as last constructor argument.
+template<typename Method, typename FnTy, typename PtCont>
+Method makeMethod(FnTy Fn, const PtCont &Pts, std::uint64_t Seed) {
+  if constexpr (std::is_constructible_v<Method, FnTy, const PtCont &, std::uint64_t>)
+    return Method(Fn, Pts, Seed);
+  else
+    return Method(Fn, Pts);
+}
+
 template<typename I, typename... Methods>
 struct CalcNextMixedRandom;
 
@@ -320,10 +413,25 @@ struct CalcNextMixedRandom;
 template<size_t... Probs, typename... Methods>
 struct CalcNextMixedRandom<std::index_sequence<Probs...>, Methods...> : Methods... {
   static_assert(sizeof...(Probs) == sizeof...(Methods), "Wrong mixed parameters");
+  static_assert((Probs + ...) > 0, "At least one method should have non-zero probability");
   static constexpr IdxType UsedPts = std::max({Methods::UsedPts...});
+  static constexpr bool UsesDiff = (UsesDiffV<Methods> || ...);
+  // Hides Batchable of batchable submethod: batch would run only its step.
+  static constexpr bool Batchable = false;
+
+private:
+  SplitMix64 Rnd;
 
+  // Every submethod gets its own seed, so random submethods don't
+  // repeat each other.
+  template<typename FnTy, typename PtCont, size_t... Idx>
+  CalcNextMixedRandom(FnTy Fn, const PtCont &Pts, std::uint64_t Seed, std::index_sequence<Idx...>):
+    Methods(makeMethod<Methods>(Fn, Pts, mixBits(Seed + Idx)))..., Rnd(Seed) {}
+
+public:
   template<typename FnTy, typename PtCont>
-  CalcNextMixedRandom(FnTy Fn, const PtCont &Pts): Methods(Fn, Pts)... {}
+  CalcNextMixedRandom(FnTy Fn, const PtCont &Pts, std::uint64_t Seed):
+    CalcNextMixedRandom(Fn, Pts, Seed, std::index_sequence_for<Methods...>()) {}
 
 private:
   template<typename T, typename FnTy, typename NormTy, typename PtCont>
@@ -334,13 +442,18 @@ private:
 public:
   template<typename FnTy, typename NormTy, typename PtCont>
   ValType get(FnTy Fn, NormTy Norm, const PtCont &Pts) {
-    static std::mt19937 Rnd(static_cast<unsigned>(Norm(Fn(Pts.front()))));
-    static std::discrete_distribution<size_t> Distr({Probs...});
     using HelperTy = ValType (CalcNextMixedRandom::*)(FnTy, NormTy, const PtCont &);
     static const HelperTy MethArr[] = {&CalcNextMixedRandom::lambdaHelper<Methods, FnTy, NormTy, PtCont>...};
+    static constexpr size_t Weights[] = {Probs...};
 
+    // Discrete distribution by hand: std::discrete_distribution
+    // is implementation-defined and images should be reproducible.
+    size_t Pick = Rnd() % (Probs + ...);
+    size_t Idx = 0;
+    while (Pick >= Weights[Idx])
+      Pick -= Weights[Idx++];
 
-    return (this->*MethArr[Distr(Rnd)])(Fn, Norm, Pts);
+    return (this->*MethArr[Idx])(Fn, Norm, Pts);
   }
 
   template<typename FnTy, typename PtCont>
@@ -355,8 +468,9 @@ struct MethodWrap : Method {
   using Method::get;
   using Method::update;
 
-  template<typename...Args>
-  MethodWrap(Args&&... args): Method(std::forward<Args>(args)...) {}
+  template<typename FnTy, typename PtCont>
+  MethodWrap(FnTy Fn, const PtCont &Pts, std::uint64_t Seed):
+    Method(makeMethod<Method>(Fn, Pts, Seed + Idx)) {}
 };
 
 template<typename I, typename... Methods>
@@ -364,9 +478,13 @@ struct CalcNextMixedHelper;
 
 template<size_t... Idx, typename... Methods>
 struct CalcNextMixedHelper<std::index_sequence<Idx...>, Methods...> : MethodWrap<Idx, Methods>... {
+private:
+  size_t Counter = 0;
+
+public:
   template<typename FnTy, typename PtCont>
-  CalcNextMixedHelper(FnTy Fn, const PtCont &Pts):
-    MethodWrap<Idx, Methods>(Fn, Pts)... {}
+  CalcNextMixedHelper(FnTy Fn, const PtCont &Pts, std::uint64_t Seed):
+    MethodWrap<Idx, Methods>(Fn, Pts, Seed)... {}
 
 private:
   template<typename T, typename FnTy, typename NormTy, typename PtCont>
@@ -377,7 +495,6 @@ private:
 public:
   template<typename FnTy, typename NormTy, typename PtCont>
   ValType get(FnTy Fn, NormTy Norm, const PtCont &Pts) {
-    static size_t Counter = 0;
     using HelperTy = ValType (CalcNextMixedHelper::*)(FnTy, NormTy, const PtCont &);
     static const HelperTy MethArr[] = {&CalcNextMixedHelper::lambdaHelper<MethodWrap<Idx, Methods>, FnTy, NormTy, PtCont>...};
 
@@ -402,42 +519,300 @@ struct CalcNextMixed: CalcNextMixedHelper<std::index_sequence_for<Methods...>, M
   using Base::update;
 
   static constexpr IdxType UsedPts = std::max({Methods::UsedPts...});
+  static constexpr bool UsesDiff = (UsesDiffV<Methods> || ...);
+  // Sequence of methods isn't batchable even if some of them is.
+  static constexpr bool Batchable = false;
 
   template<typename FnTy, typename PtCont>
-  CalcNextMixed(FnTy Fn, const PtCont &Pts): Base(Fn, Pts) {}
+  CalcNextMixed(FnTy Fn, const PtCont &Pts, std::uint64_t Seed): Base(Fn, Pts, Seed) {}
+};
+
+// How calculation of point has ended.
+struct PointStats {
+  // Iterations made.
+  int Iters = 0;
+  // Stopped because of NaN (or infinity, see isLost).
+  bool NaN = false;
+  // Stopped because point fell into cycle (see CycleDetector).
+  bool Cycled = false;
+  // If set by caller, time of bootstrap (initial points of method)
+  // and of iterations is measured too.
+  bool Timed = false;
+  std::chrono::nanoseconds BootstrapTime{0};
+  std::chrono::nanoseconds IterateTime{0};
+};
+
+template<typename Method, typename = void>
+struct IsBatchable : std::false_type {};
+
+template<typename Method>
+struct IsBatchable<Method, std::void_t<decltype(Method::Batchable)>> :
+  std::bool_constant<Method::Batchable> {};
+
+template<typename Method>
+constexpr bool IsBatchableV = IsBatchable<Method>::value;
+
+// Points of orbit closer than that relative to their size (or absolute,
+// for points smaller than 1) are taken as the same point. Orbit that
+// is attracted to cycle reaches it only in the limit.
+template<typename T>
+constexpr T CycleTolerance = std::is_same_v<T, float> ? T(1e-5) : T(1e-9);
+
+template<typename T>
+static bool isSamePoint(std::complex<T> A, std::complex<T> B) {
+  T Tol = CycleTolerance<T> * std::max({T(1), std::abs(B.real()), std::abs(B.imag())});
+  return std::abs(A.real() - B.real()) <= Tol && std::abs(A.imag() - B.imag()) <= Tol;
+}
+
+// Iterations of point are over if it got NaN or, with StopCycles, went
+// to infinity (steps don't bring it back from there).
+template<typename T>
+static bool isLost(std::complex<T> Pt, const IterLimits &Limits) {
+  if (Limits.StopCycles)
+    return !std::isfinite(Pt.real()) || !std::isfinite(Pt.imag());
+  return std::isnan(Pt.real()) || std::isnan(Pt.imag());
+}
+
+// Brent's cycle detection for points that don't converge. Point of
+// orbit is saved after 1, 2, 4, 8, ... steps and every next point is
+// compared with it, so orbit that fell into cycle of period P is
+// stopped within 2P steps after saved point gets on the cycle. Stalled
+// iterations are cycles of period 1. Only current point is compared,
+// which is whole state only of batchable methods: multi-point and
+// mixed methods can repeat point and still converge, so they are
+// stopped only by isLost. PtTy is ValType or lanes that share the same
+// schedule.
+template<typename PtTy>
+class CycleDetector {
+  PtTy Saved;
+  int Power = 1;
+  int Steps = 0;
+
+public:
+  explicit CycleDetector(const PtTy &Start): Saved(Start) {}
+
+  const PtTy &getSaved() const {
+    return Saved;
+  }
+
+  // Called for every point of orbit after it is compared with saved one.
+  void advance(const PtTy &Pt) {
+    if (++Steps < Power)
+      return;
+    Saved = Pt;
+    Power *= 2;
+    Steps = 0;
+  }
 };
 
 template<typename Method, typename FnTy, typename NormTy, typename ColorFnTy>
 static PtColor
-getPointIndexN(FnTy Fn, NormTy Norm, ColorFnTy ColorFn, ValType Init) {
+getPointIndexN(FnTy Fn, NormTy Norm, ColorFnTy ColorFn, IterLimits Limits, ValType Init,
+               std::uint64_t Seed, PointStats *Stats = nullptr) {
+  using Clock = std::chrono::steady_clock;
   constexpr IdxType UsedPts = Method::UsedPts;
 
-  CircularBuffer<ValType, UsedPts> Pts([Fn, Norm, Pt = Init]() mutable -> ValType {
-      const CircularBuffer<ValType, 1> PtBuf([Pt]() -> ValType {
-          return Pt;
-        });
-
-      CalcNextSteffensen Stf(Fn, PtBuf);
-      Pt = Stf.get(Fn, Norm, PtBuf);
-      return PtBuf.front();
+  bool Timed = Stats && Stats->Timed;
+  Clock::time_point Start;
+  if (Timed)
+    Start = Clock::now();
+
+  // Initial points are made by Steffensen's method.
+  CircularBuffer<FnPoint, UsedPts> Pts([Fn, Cur = evalPoint<Method>(Fn, Init),
+                                        Started = false]() mutable -> FnPoint {
+      if (Started) {
+        ValType Next = CalcNextSteffensen::step(Fn, Cur.Pt, Cur.Val);
+        Cur = evalPoint<Method>(Fn, Next);
+      }
+      Started = true;
+      return Cur;
     });
 
-  Method Mth(Fn, Pts);
+  Method Mth = makeMethod<Method>(Fn, Pts, Seed);
 
-  for (int i = 0; i < MaxIters; ++i) {
+  if (Timed) {
+    Clock::time_point Now = Clock::now();
+    Stats->BootstrapTime = Now - Start;
+    Start = Now;
+  }
+
+  auto Finish = [Stats, Timed, &Start](int Iters, bool NaN, bool Cycled = false) {
+    if (!Stats)
+      return;
+    Stats->Iters = Iters;
+    Stats->NaN = NaN;
+    Stats->Cycled = Cycled;
+    if (Timed)
+      Stats->IterateTime = Clock::now() - Start;
+  };
+
+  CycleDetector<ValType> Cycles(Init);
+  for (int i = 0; i < Limits.MaxIters; ++i) {
     ValType Next = Mth.get(Fn, Norm, Pts);
-    if (std::isnan(Next.real()) || std::isnan(Next.imag()))
-      break;
+    if (isLost(Next, Limits)) {
+      Finish(i + 1, true);
+      return {false, false};
+    }
 
-    if (Norm(Fn(Next)) < Epsilon)
+    FnPoint P = evalPoint<Method>(Fn, Next);
+    if (Norm.isBelow(P.Val, Limits.Epsilon)) {
+      Finish(i + 1, false);
       return {true, ColorFn(Next, i)};
+    }
+
+    if (IsBatchableV<Method> && Limits.StopCycles) {
+      if (isSamePoint(Next, Cycles.getSaved())) {
+        Finish(i + 1, false, true);
+        return {false, true};
+      }
+      Cycles.advance(Next);
+    }
 
-    Pts.push_back(Next);
+    Pts.push_back(P);
 
     Mth.update(Fn, Pts);
   }
 
+  Finish(Limits.MaxIters, false);
   return {false, false};
 }
 
+// Iterates Pt of batchable method in ValType. Pt is result of
+// iteration Iter or initial point if Iter is -1. Pt itself is only
+// saved for cycle detection: points are compared with it from the
+// next iteration on, as in getPointIndexN.
+template<typename Method, typename FnTy, typename NormTy, typename ColorFnTy>
+static std::pair<PtColor, PointStats>
+iterateScalar(FnTy Fn, NormTy Norm, ColorFnTy ColorFn, IterLimits Limits, ValType Pt, int Iter) {
+  FnPoint P = evalPoint<Method>(Fn, Pt);
+  CycleDetector<ValType> Cycles(Pt);
+  const int FirstIter = Iter;
+  while (true) {
+    if (Iter >= 0 && Norm.isBelow(P.Val, Limits.Epsilon))
+      return {PtColor(true, ColorFn(P.Pt, Iter)), PointStats{Iter + 1, false}};
+    if (Iter > FirstIter && Limits.StopCycles) {
+      if (isSamePoint(P.Pt, Cycles.getSaved()))
+        return {PtColor(false, true), PointStats{Iter + 1, false, true}};
+      Cycles.advance(P.Pt);
+    }
+    if (++Iter >= Limits.MaxIters)
+      return {PtColor(false, false), PointStats{Limits.MaxIters, false}};
+    if constexpr (IsFusedV<Method, FnTy>)
+      Pt = Method::step(Fn, P.Pt, P.Val, P.Diff);
+    else
+      Pt = Method::step(Fn, P.Pt, P.Val);
+    if (isLost(Pt, Limits))
+      return {PtColor(false, false), PointStats{Iter + 1, true}};
+    P = evalPoint<Method>(Fn, Pt);
+  }
+}
+
+// Iterates point at Offset from start of reference Orbit of deep zoom
+// (see Deep.hpp). Until offset can be rebased it is advanced linearly
+// and only convergence test is made in ValType.
+template<typename Method, typename FnTy, typename NormTy, typename ColorFnTy>
+static std::pair<PtColor, PointStats>
+getPointIndexDeep(FnTy Fn, NormTy Norm, ColorFnTy ColorFn, IterLimits Limits,
+                  const DeepOrbit &Orbit, ValType Offset) {
+  static_assert(IsBatchableV<Method>, "Method can't be used for deep zoom");
+  for (int Iter = -1; ; ++Iter) {
+    IdxType Idx = Iter + 1;
+    ValType Pt = Orbit.getPoint(Idx, Offset);
+    if (!Orbit.canFollow(Idx, Offset))
+      return iterateScalar<Method>(Fn, Norm, ColorFn, Limits, Pt, Iter);
+    if (Iter >= 0 && Norm.isBelow(Fn(Pt), Limits.Epsilon))
+      return {PtColor(true, ColorFn(Pt, Iter)), PointStats{Iter + 1, false}};
+    if (Iter + 1 >= Limits.MaxIters)
+      return {PtColor(false, false), PointStats{Limits.MaxIters, false}};
+    Offset = Orbit.advance(Idx, Offset);
+  }
+}
+
+// Same as getPointIndexN but advances N points in lockstep in
+// precision given by UsedPrecision. Lanes that converged, got NaN or
+// fell into cycle are masked out until whole batch is done. Only first Count lanes
+// are reported with SetRes(Lane, PtColor, PointStats), the rest are
+// padding. Times aren't measured per lane.
+template<typename Method, unsigned N, typename FnTy, typename NormTy, typename ColorFnTy,
+         typename SetResTy>
+static void
+getPointIndexBatch(FnTy Fn, NormTy Norm, ColorFnTy ColorFn, IterLimits Limits,
+                   const ValType *Init, unsigned Count, SetResTy SetRes) {
+  static_assert(IsBatchableV<Method>, "Method can't be used on batches");
+  using LanesTy = ComplexLanes<N, IterFloatType>;
+  constexpr bool Mixed = UsedPrecision == Precision::Mixed;
+
+  LanesTy Pts(Init);
+  CycleDetector<LanesTy> Cycles(Pts);
+  LanesTy Vals, Diffs;
+  auto Eval = [&Fn](const LanesTy &Pt, LanesTy &Val, LanesTy &Diff) {
+    if constexpr (IsFusedV<Method, FnTy>)
+      std::tie(Val, Diff) = Fn.withDiff(Pt);
+    else
+      Val = Fn(Pt);
+  };
+  Eval(Pts, Vals, Diffs);
+  bool Active[N];
+  unsigned Left = Count;
+  for (unsigned k = 0; k < N; ++k)
+    Active[k] = k < Count;
+
+  for (int i = 0; i < Limits.MaxIters && Left; ++i) {
+    LanesTy Next;
+    if constexpr (IsFusedV<Method, FnTy>)
+      Next = Method::step(Fn, Pts, Vals, Diffs);
+    else
+      Next = Method::step(Fn, Pts, Vals);
+    LanesTy FnNext, DiffNext;
+    Eval(Next, FnNext, DiffNext);
+    auto Converged = Norm.isBelow(FnNext, Limits.Epsilon);
+
+    for (unsigned k = 0; k < N; ++k) {
+      if (!Active[k])
+        continue;
+
+      if (isLost(Next[k], Limits)) {
+        // Float overflows much earlier than double.
+        if constexpr (Mixed) {
+          auto Res = iterateScalar<Method>(Fn, Norm, ColorFn, Limits, Init[k], -1);
+          SetRes(k, Res.first, Res.second);
+        } else {
+          SetRes(k, PtColor(false, false), PointStats{i + 1, true});
+        }
+        Active[k] = false;
+        --Left;
+      } else if (Converged[k]) {
+        if constexpr (Mixed) {
+          auto Res = iterateScalar<Method>(Fn, Norm, ColorFn, Limits, ValType(Next[k]), i);
+          SetRes(k, Res.first, Res.second);
+        } else {
+          SetRes(k, PtColor(true, ColorFn(ValType(Next[k]), i)), PointStats{i + 1, false});
+        }
+        Active[k] = false;
+        --Left;
+      } else if (Limits.StopCycles && isSamePoint(Next[k], Cycles.getSaved()[k])) {
+        // Float may stall where double still converges.
+        if constexpr (Mixed) {
+          auto Res = iterateScalar<Method>(Fn, Norm, ColorFn, Limits, ValType(Next[k]), i);
+          SetRes(k, Res.first, Res.second);
+        } else {
+          SetRes(k, PtColor(false, true), PointStats{i + 1, false, true});
+        }
+        Active[k] = false;
+        --Left;
+      }
+    }
+    if (Limits.StopCycles)
+      Cycles.advance(Next);
+
+    Pts = Next;
+    Vals = FnNext;
+    Diffs = DiffNext;
+  }
+
+  for (unsigned k = 0; k < N; ++k)
+    if (Active[k])
+      SetRes(k, PtColor(false, false), PointStats{Limits.MaxIters, false});
+}
+
 #endif
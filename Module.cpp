@@ -0,0 +1,32 @@
+#include "Module.h"
+
+#include <stdexcept>
+
+#include <dlfcn.h>
+
+#define FRACGEN_STRINGIFY(X) #X
+#define FRACGEN_ENTRY_NAME(X) FRACGEN_STRINGIFY(X)
+
+// Module path of runFracGen draws and writes image before it returns
+// (renderImage is called without Pending), so module is unloaded only
+// when nothing uses it. dlopen counts references, so the same path
+// loaded by overlapping runs stays mapped until the last of them ends.
+LoadedModule::LoadedModule(const std::string &Path) {
+  Handle = dlopen(Path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (!Handle)
+    throw std::runtime_error("Can't load module " + Path + ": " + dlerror());
+  using EntryTy = const CompiledFractal *(*)();
+  auto Entry = reinterpret_cast<EntryTy>(dlsym(Handle, FRACGEN_ENTRY_NAME(FRACGEN_MODULE_ENTRY)));
+  if (Entry)
+    Fractal = Entry();
+  if (!Fractal || Fractal->OptionsSize != sizeof(RenderOptions) ||
+      Fractal->ResultSize != sizeof(FractalResult)) {
+    dlclose(Handle);
+    throw std::runtime_error(Entry ? "Module " + Path + " is built for other FracGen"
+                                   : "Module " + Path + " has no entry point");
+  }
+}
+
+LoadedModule::~LoadedModule() {
+  dlclose(Handle);
+}
@@ -0,0 +1,55 @@
+#ifndef FRACGEN_MODULE_H_DEFINED__
+#define FRACGEN_MODULE_H_DEFINED__
+
+#include "Cache.h"
+#include "Options.h"
+#include "Profile.h"
+#include "Result.h"
+#include "Screen.h"
+
+#include <string>
+
+#include <cstddef>
+
+// Entry points of expression compiled into FracGen. Expression is either
+// linked into FracGen or compiled into shared object (module) by
+// frac-gen.rb and loaded by FracGen --module, so one FracGen can render
+// many compiled expressions. Modules are built from the same sources
+// as FracGen they are loaded into (frac-gen.rb keys them by hash of
+// sources), sizes of shared types only catch accidental mismatches.
+struct CompiledFractal {
+  std::size_t OptionsSize;
+  std::size_t ResultSize;
+  FractalResult (*GetFractal)(const RenderOptions &Opts, int RowBegin, int RowEnd,
+                              const ReusedPoints *Reused, RenderProfile *Profile);
+  ScreenResult (*ScreenFractal)(const RenderOptions &Opts);
+  std::string (*GetResultKey)(const RenderOptions &Opts);
+};
+
+// Name of function of module that returns its CompiledFractal.
+#define FRACGEN_MODULE_ENTRY getFracGenModule
+
+// Expression linked into FracGen.
+const CompiledFractal &getLinkedFractal();
+
+// Module loaded for one run of FracGen. It is unloaded when the last
+// LoadedModule of its path is destroyed, so --serve doesn't keep every
+// module it has rendered mapped; nothing returned by module may outlive it.
+class LoadedModule {
+  void *Handle = nullptr;
+  const CompiledFractal *Fractal = nullptr;
+
+public:
+  // Throws std::runtime_error if module can't be loaded or was built
+  // for other FracGen.
+  explicit LoadedModule(const std::string &Path);
+  ~LoadedModule();
+  LoadedModule(const LoadedModule &) = delete;
+  LoadedModule &operator=(const LoadedModule &) = delete;
+
+  const CompiledFractal &getFractal() const {
+    return *Fractal;
+  }
+};
+
+#endif
@@ -1 +1,3 @@
-static auto UsedNorm = [](ValType V) { return <%= norm %>(V); };
+static const auto UsedNorm = makeNorm([](auto V) { return <%= norm %>(V); },
+                                      [](auto V, FloatType Limit) { return <%= norm %>Below(V, Limit); });
+static constexpr const char *UsedNormName = "<%= norm %>";
@@ -1,8 +1,11 @@
 #ifndef FRACGEN_NORMS_H_DEFINED___
 #define FRACGEN_NORMS_H_DEFINED___
 
+#include "Lanes.hpp"
 #include "Types.h"
 
+#include <algorithm>
+
 #include <cmath>
 
 // P-norms {{
@@ -34,6 +37,140 @@ FloatType normC(ValType V) {
   return 3.0 * std::abs(V.real()) + std::sqrt(2.0 * std::abs(V.imag()) + std::pow(std::abs(V.real()), 5.0));
 }
 
+// Lane versions of norms {{
+
+template<unsigned N, typename T>
+RealLanes<N, T> norm2(const ComplexLanes<N, T> &V) {
+  return abs(V);
+}
+
+template<unsigned N, typename T>
+RealLanes<N, T> norm1(const ComplexLanes<N, T> &V) {
+  RealLanes<N, T> Res;
+  for (unsigned k = 0; k < N; ++k)
+    Res.V[k] = std::abs(V.Re[k]) + std::abs(V.Im[k]);
+  return Res;
+}
+
+template<unsigned N, typename T>
+RealLanes<N, T> normInf(const ComplexLanes<N, T> &V) {
+  RealLanes<N, T> Res;
+  for (unsigned k = 0; k < N; ++k)
+    Res.V[k] = std::max(std::abs(V.Re[k]), std::abs(V.Im[k]));
+  return Res;
+}
+
+template<unsigned N, typename T>
+RealLanes<N, T> normC(const ComplexLanes<N, T> &V) {
+  RealLanes<N, T> Res;
+  for (unsigned k = 0; k < N; ++k) {
+    T Re = std::abs(V.Re[k]);
+    T Re2 = Re * Re;
+    Res.V[k] = T(3) * Re + std::sqrt(T(2) * std::abs(V.Im[k]) + Re2 * Re2 * Re);
+  }
+  return Res;
+}
+
+// }} lane versions.
+
+// Comparison forms {{
+// normXBelow(V, Limit) is the same test as normX(V) < Limit without
+// square roots and powers, so convergence test of every iteration is
+// cheap. Comparisons are combined with & to keep lane loops branch-free.
+
+static inline
+bool norm2Below(ValType V, FloatType Limit) {
+  return V.real() * V.real() + V.imag() * V.imag() < Limit * Limit;
+}
+
+static inline
+bool norm1Below(ValType V, FloatType Limit) {
+  return norm1(V) < Limit;
+}
+
+static inline
+bool normInfBelow(ValType V, FloatType Limit) {
+  return (std::abs(V.real()) < Limit) & (std::abs(V.imag()) < Limit);
+}
+
+// sqrt(X) < D is X < D * D for positive D.
+static inline
+bool normCBelow(ValType V, FloatType Limit) {
+  FloatType Re = std::abs(V.real());
+  FloatType Re2 = Re * Re;
+  FloatType D = Limit - 3.0 * Re;
+  return (D > 0) & (2.0 * std::abs(V.imag()) + Re2 * Re2 * Re < D * D);
+}
+
+template<unsigned N, typename T>
+LaneMask<N> norm2Below(const ComplexLanes<N, T> &V, FloatType Limit) {
+  T L = static_cast<T>(Limit);
+  LaneMask<N> Res;
+  for (unsigned k = 0; k < N; ++k)
+    Res.V[k] = V.Re[k] * V.Re[k] + V.Im[k] * V.Im[k] < L * L;
+  return Res;
+}
+
+template<unsigned N, typename T>
+LaneMask<N> norm1Below(const ComplexLanes<N, T> &V, FloatType Limit) {
+  T L = static_cast<T>(Limit);
+  LaneMask<N> Res;
+  for (unsigned k = 0; k < N; ++k)
+    Res.V[k] = std::abs(V.Re[k]) + std::abs(V.Im[k]) < L;
+  return Res;
+}
+
+template<unsigned N, typename T>
+LaneMask<N> normInfBelow(const ComplexLanes<N, T> &V, FloatType Limit) {
+  T L = static_cast<T>(Limit);
+  LaneMask<N> Res;
+  for (unsigned k = 0; k < N; ++k)
+    Res.V[k] = (std::abs(V.Re[k]) < L) & (std::abs(V.Im[k]) < L);
+  return Res;
+}
+
+template<unsigned N, typename T>
+LaneMask<N> normCBelow(const ComplexLanes<N, T> &V, FloatType Limit) {
+  T L = static_cast<T>(Limit);
+  LaneMask<N> Res;
+  for (unsigned k = 0; k < N; ++k) {
+    T Re = std::abs(V.Re[k]);
+    T Re2 = Re * Re;
+    T D = L - T(3) * Re;
+    Res.V[k] = (D > T(0)) & (T(2) * std::abs(V.Im[k]) + Re2 * Re2 * Re < D * D);
+  }
+  return Res;
+}
+
+// }} comparison forms.
+
+// Norm together with its comparison form. Norm(V) gives value of
+// norm (for colors and methods that compare norms), Norm.isBelow(V,
+// Limit) is convergence test.
+template<typename NormFnTy, typename BelowFnTy>
+class NormWithTest {
+  NormFnTy NormFn;
+  BelowFnTy BelowFn;
+
+public:
+  NormWithTest(NormFnTy NormFn, BelowFnTy BelowFn): NormFn(NormFn), BelowFn(BelowFn) {}
+
+  template<typename T>
+  auto operator()(const T &V) const {
+    return NormFn(V);
+  }
+
+  template<typename T>
+  auto isBelow(const T &V, FloatType Limit) const {
+    return BelowFn(V, Limit);
+  }
+};
+
+template<typename NormFnTy, typename BelowFnTy>
+NormWithTest<NormFnTy, BelowFnTy> makeNorm(NormFnTy NormFn, BelowFnTy BelowFn) {
+  return NormWithTest<NormFnTy, BelowFnTy>(NormFn, BelowFn);
+}
+
 // Used norm is here.
 #include "Norm.X.h"
 
@@ -0,0 +1,44 @@
+#ifndef FRACGEN_OPTIONS_H_DEFINED__
+#define FRACGEN_OPTIONS_H_DEFINED__
+
+#include "Palette.h"
+#include "Parallel.hpp"
+#include "Types.h"
+#include "Viewport.h"
+
+#include <string>
+
+#include <cstdint>
+
+// Options of single FracGen run that do not require recompilation.
+struct RenderOptions {
+  unsigned Threads = getDefaultThreads();
+  // Rendered part of plane. Frames of sequence change it.
+  Viewport View{0.0, 0.0, 20.0, 1000, 1000};
+  // When iterations of point stop.
+  IterLimits Limits;
+  // Seed of image. Every pixel derives its own seed from it.
+  std::uint64_t Seed = 0;
+  // Bits per channel of written image, 8 or 16.
+  unsigned Depth = 8;
+  // Don't use Magick++ even if FracGen is built with it.
+  bool BuiltinWriter = false;
+  // If not zero image is rendered and written by bands of that many rows.
+  unsigned BandHeight = 0;
+  // Fill uniform blocks without calculating every point (see Adaptive.hpp).
+  bool Adaptive = false;
+  // If not zero, pixels on edges get that many extra samples.
+  unsigned Antialias = 0;
+  // Colors of points.
+  Palette::Kind Colors = Palette::Kind::Classic;
+  // Stretch levels of image by its histogram (see Drawer.cpp).
+  bool ToneMap = true;
+  // Directory of result cache (see Cache.h), no caching if empty.
+  std::string CacheDir;
+  // Print summary of times and iterations (see Profile.h).
+  bool Profile = false;
+  // Write image of iterations of every pixel next to image.
+  bool Heatmap = false;
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include "Palette.h"
+
+#include "Config.h"
+
+#include <cmath>
+
+namespace {
+
+constexpr double Pi = 3.14159265358979323846;
+constexpr double Pi23 = 2.094395102;
+
+// Hue of HSV with full saturation and value, H from [0, 1).
+void getHue(double H, float *C) {
+  double Sector = H * 6.0;
+  int S = static_cast<int>(Sector) % 6;
+  float F = static_cast<float>(Sector - std::floor(Sector));
+  const float Rise = F, Fall = 1.0f - F;
+  const float Table[6][3] = {
+    {1.0f, Rise, 0.0f}, {Fall, 1.0f, 0.0f}, {0.0f, 1.0f, Rise},
+    {0.0f, Fall, 1.0f}, {Rise, 0.0f, 1.0f}, {1.0f, 0.0f, Fall},
+  };
+  for (int c = 0; c < 3; ++c)
+    C[c] = Table[S][c];
+}
+
+} // namespace
+
+Palette::Palette(Kind K):
+  Args(65536), Intensity(65536),
+  Cycled(K == Kind::Gray ? RGBColor(0.1, 0.1, 0.3) : RGBColor(0.2, 0.2, 0.2)) {
+  for (unsigned Q = 0; Q < Args.size(); ++Q) {
+    // The same argument as of unpacked point.
+    PackedPoint Pt{static_cast<std::uint16_t>(Q), 0, 1, PackedPoint::Converged};
+    double Arg = Pt.getColor().getArg();
+    ArgEntry &E = Args[Q];
+    for (int c = 0; c < 3; ++c)
+      E.Base[c] = E.Near[c] = 0.0f;
+
+    switch (K) {
+    case Kind::Classic:
+      // Red - blue, blue - green, green - red; the third component
+      // is closeness.
+      if (std::cos(Arg) >= 0.5) {
+        double Norm = Arg / Pi23 + 1.5;
+        E.Base[0] = Norm;
+        E.Base[2] = 1.0 - Norm;
+        E.Near[1] = 1.0f;
+      } else if (Arg <= 0) {
+        double Norm = Arg / Pi23 + 0.5;
+        E.Base[2] = Norm;
+        E.Base[1] = 1.0 - Norm;
+        E.Near[0] = 1.0f;
+      } else {
+        double Norm = Arg / Pi23 - 0.5;
+        E.Base[1] = Norm;
+        E.Base[0] = 1.0 - Norm;
+        E.Near[2] = 1.0f;
+      }
+      break;
+    case Kind::Rainbow:
+      getHue((Arg + Pi) / (2.0 * Pi), E.Base);
+      for (int c = 0; c < 3; ++c) {
+        E.Base[c] *= 0.75f;
+        E.Near[c] = 0.25f;
+      }
+      break;
+    case Kind::Gray:
+      for (int c = 0; c < 3; ++c) {
+        E.Base[c] = 0.75f;
+        E.Near[c] = 0.25f;
+      }
+      break;
+    }
+  }
+
+  for (unsigned Iters = 0; Iters < Intensity.size(); ++Iters)
+    Intensity[Iters] = 1.0 - (std::log(static_cast<double>(Iters)) /
+                              std::log(static_cast<double>(ItersLogBase)));
+}
+
+auto Palette::get(Kind K) -> const Palette & {
+  // Function-local statics are built once even if asked from several threads.
+  switch (K) {
+  case Kind::Rainbow: {
+    static const Palette Rainbow(Kind::Rainbow);
+    return Rainbow;
+  }
+  case Kind::Gray: {
+    static const Palette Gray(Kind::Gray);
+    return Gray;
+  }
+  default: {
+    static const Palette Classic(Kind::Classic);
+    return Classic;
+  }
+  }
+}
+
+auto Palette::parse(const std::string &Name, Kind &K) -> bool {
+  if (Name == "classic")
+    K = Kind::Classic;
+  else if (Name == "rainbow")
+    K = Kind::Rainbow;
+  else if (Name == "gray")
+    K = Kind::Gray;
+  else
+    return false;
+  return true;
+}
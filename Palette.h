@@ -0,0 +1,68 @@
+#ifndef FRACGEN_PALETTE_H_DEFINED__
+#define FRACGEN_PALETTE_H_DEFINED__
+
+#include "Color.h"
+#include "Result.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Colors of converged points by table lookups instead of trigonometry
+// and logarithms of PointColor::getRGB. Color of point is
+// (Base[Arg] + Closeness * Near[Arg]) * Intensity[Iters], where Arg is
+// quantized argument of point, Closeness = 1 - norm / Epsilon and
+// Intensity falls logarithmically from 1 at first iteration to 0 at
+// ItersLogBase. Points are kept quantized (see PackedPoint), so tables
+// cover every possible argument and number of iterations. Tables depend
+// only on palette: image can be recolored without calculation of points.
+// Points stopped in cycles (see CycleDetector) have dim color of their
+// own, the rest of points that haven't converged are black.
+class Palette {
+public:
+  enum class Kind {
+    // Colors of PointColor::getRGB.
+    Classic,
+    // Continuous hue by argument, lighter near root.
+    Rainbow,
+    // Only closeness and iterations.
+    Gray,
+  };
+
+  using RGBColor = PointColor::RGBColor;
+
+private:
+  struct ArgEntry {
+    float Base[3];
+    float Near[3];
+  };
+
+  std::vector<ArgEntry> Args;
+  std::vector<double> Intensity;
+  RGBColor Cycled;
+
+  explicit Palette(Kind K);
+
+public:
+  Palette(const Palette &) = delete;
+  Palette &operator=(const Palette &) = delete;
+
+  // Tables of every palette are built once on first use.
+  static const Palette &get(Kind K);
+
+  // Palette by name ("classic", "rainbow", "gray"), false if unknown.
+  static bool parse(const std::string &Name, Kind &K);
+
+  RGBColor getColor(const PackedPoint &Pt) const {
+    if (!Pt.isConverged())
+      return Pt.isCycled() ? Cycled : RGBColor(0.0, 0.0, 0.0);
+    const ArgEntry &A = Args[Pt.Arg];
+    double Closeness = 1.0 - Pt.Norm / 65535.0;
+    double I = Intensity[Pt.Iters];
+    return RGBColor((A.Base[0] + Closeness * A.Near[0]) * I,
+                    (A.Base[1] + Closeness * A.Near[1]) * I,
+                    (A.Base[2] + Closeness * A.Near[2]) * I);
+  }
+};
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef FRACGEN_PARALLEL_HPP_DEFINED__
+#define FRACGEN_PARALLEL_HPP_DEFINED__
+
+#include "Types.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <cstdint>
+
+// Work-stealing scheduler over tile indices [0, NumTiles).
+// Every worker owns contiguous slice of tiles and takes them from the front.
+// When own slice is empty worker steals back half of someone else's slice,
+// so expensive regions of image don't stall single thread.
+class TileScheduler {
+  // Slice is packed into one word to be updated with single CAS:
+  // begin in lower half, end in upper half.
+  struct alignas(64) Slice {
+    std::atomic<std::uint64_t> Range;
+  };
+
+  static std::uint64_t pack(IdxType Begin, IdxType End) {
+    return static_cast<std::uint64_t>(End) << 32 | Begin;
+  }
+
+  static IdxType getBegin(std::uint64_t Range) {
+    return static_cast<IdxType>(Range);
+  }
+
+  static IdxType getEnd(std::uint64_t Range) {
+    return static_cast<IdxType>(Range >> 32);
+  }
+
+  std::unique_ptr<Slice[]> Slices;
+  unsigned Workers;
+
+  bool pop(unsigned Worker, IdxType &Tile) {
+    std::atomic<std::uint64_t> &Range = Slices[Worker].Range;
+    std::uint64_t Cur = Range.load();
+    do {
+      if (getBegin(Cur) >= getEnd(Cur))
+        return false;
+    } while (!Range.compare_exchange_weak(Cur, pack(getBegin(Cur) + 1, getEnd(Cur))));
+    Tile = getBegin(Cur);
+    return true;
+  }
+
+  bool steal(unsigned Thief, IdxType &Tile) {
+    for (unsigned i = 1; i < Workers; ++i) {
+      std::atomic<std::uint64_t> &Range = Slices[(Thief + i) % Workers].Range;
+      std::uint64_t Cur = Range.load();
+      IdxType Mid;
+      do {
+        if (getBegin(Cur) >= getEnd(Cur))
+          break;
+        Mid = getBegin(Cur) + (getEnd(Cur) - getBegin(Cur)) / 2;
+      } while (!Range.compare_exchange_weak(Cur, pack(getBegin(Cur), Mid)));
+
+      if (getBegin(Cur) >= getEnd(Cur))
+        continue;
+
+      // Nobody touches empty slice so it can be refilled without CAS.
+      Tile = Mid;
+      Slices[Thief].Range.store(pack(Mid + 1, getEnd(Cur)));
+      return true;
+    }
+    return false;
+  }
+
+public:
+  TileScheduler(IdxType NumTiles, unsigned Workers):
+    Slices(new Slice[Workers]), Workers(Workers) {
+    for (unsigned i = 0; i < Workers; ++i) {
+      IdxType Begin = static_cast<std::uint64_t>(NumTiles) * i / Workers;
+      IdxType End = static_cast<std::uint64_t>(NumTiles) * (i + 1) / Workers;
+      Slices[i].Range.store(pack(Begin, End));
+    }
+  }
+
+  bool next(unsigned Worker, IdxType &Tile) {
+    return pop(Worker, Tile) || steal(Worker, Tile);
+  }
+};
+
+// Calls Body(Tile) for every tile in [0, NumTiles) using given number of threads.
+// Calling thread is one of workers.
+template<typename BodyTy>
+void parallelTiles(unsigned Threads, IdxType NumTiles, BodyTy Body) {
+  Threads = std::max(1u, std::min<unsigned>(Threads, NumTiles));
+  TileScheduler Sched(NumTiles, Threads);
+
+  auto Worker = [&Sched, &Body](unsigned Id) {
+    IdxType Tile;
+    while (Sched.next(Id, Tile))
+      Body(Tile);
+  };
+
+  std::vector<std::thread> Pool;
+  Pool.reserve(Threads - 1);
+  for (unsigned i = 1; i < Threads; ++i)
+    Pool.emplace_back(Worker, i);
+  Worker(0);
+
+  for (auto &T : Pool)
+    T.join();
+}
+
+static inline unsigned getDefaultThreads() {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+#endif
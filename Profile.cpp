@@ -0,0 +1,141 @@
+#include "Profile.h"
+
+#include "ImageWriter.h"
+
+#include <algorithm>
+#include <iomanip>
+
+#include <cstddef>
+
+namespace {
+
+const char *const PhaseNames[RenderProfile::NumPhases] = {
+  "setup", "bootstrap", "iterate", "antialias", "colorize", "encode",
+};
+
+// Number of buckets of iterations histogram.
+constexpr int HistBuckets = 10;
+
+double toPercent(std::uint64_t Part, std::uint64_t Whole) {
+  return Whole ? 100.0 * Part / Whole : 0.0;
+}
+
+} // namespace
+
+RenderProfile::RenderProfile(unsigned Width, unsigned Height, int MaxIters):
+  Width(Width), Height(Height), MaxIters(MaxIters), Iters(std::size_t(Width) * Height),
+  Flags(std::size_t(Width) * Height) {
+  for (std::atomic<std::uint64_t> &T : Times)
+    T = 0;
+}
+
+void RenderProfile::setPoint(unsigned X, unsigned Y, int NumIters, bool IsConverged,
+                             bool IsNaN, bool IsCycled) {
+  std::size_t Idx = std::size_t(Y) * Width + X;
+  Iters[Idx] = static_cast<std::uint16_t>(std::min(NumIters, 0xffff));
+  Flags[Idx] = Calculated | (IsConverged ? Converged : 0) | (IsNaN ? NaNExit : 0) |
+    (IsCycled ? CycleExit : 0);
+}
+
+void RenderProfile::printReport(std::ostream &OS) const {
+  std::uint64_t Total = Iters.size();
+  std::uint64_t NumCalculated = 0, NumConverged = 0, NumNaN = 0, NumCycled = 0;
+  std::uint64_t TotalIters = 0, ConvergedIters = 0;
+  std::uint64_t Hist[HistBuckets] = {};
+  for (std::size_t Idx = 0; Idx < Iters.size(); ++Idx) {
+    if (!(Flags[Idx] & Calculated))
+      continue;
+    ++NumCalculated;
+    TotalIters += Iters[Idx];
+    if (Flags[Idx] & NaNExit)
+      ++NumNaN;
+    if (Flags[Idx] & CycleExit)
+      ++NumCycled;
+    if (Flags[Idx] & Converged) {
+      ++NumConverged;
+      ConvergedIters += Iters[Idx];
+      ++Hist[std::min((Iters[Idx] - 1) * HistBuckets / MaxIters, HistBuckets - 1)];
+    }
+  }
+  std::uint64_t NumMaxIters = NumCalculated - NumConverged - NumNaN - NumCycled;
+
+  auto OldFlags = OS.flags();
+  auto OldPrecision = OS.precision();
+  OS << std::fixed << std::setprecision(1);
+
+  OS << "Time, ms (bootstrap and iterate are summed over threads):\n";
+  for (unsigned P = 0; P < NumPhases; ++P)
+    OS << "  " << std::left << std::setw(10) << PhaseNames[P] << std::right << std::setw(12)
+       << Times[P].load() / 1e6 << '\n';
+
+  OS << "Points: " << Total << ", calculated " << NumCalculated << " ("
+     << toPercent(NumCalculated, Total) << "%), rest are cached or interpolated\n";
+  OS << "  converged    " << std::setw(12) << NumConverged << std::setw(8)
+     << toPercent(NumConverged, NumCalculated) << "%\n";
+  OS << "  NaN exits    " << std::setw(12) << NumNaN << std::setw(8)
+     << toPercent(NumNaN, NumCalculated) << "%\n";
+  OS << "  cycles       " << std::setw(12) << NumCycled << std::setw(8)
+     << toPercent(NumCycled, NumCalculated) << "%\n";
+  OS << "  hit MaxIters " << std::setw(12) << NumMaxIters << std::setw(8)
+     << toPercent(NumMaxIters, NumCalculated) << "%\n";
+
+  double IterTime = Times[static_cast<unsigned>(Phase::Iterate)].load();
+  OS << "Iterations: " << TotalIters << ", "
+     << (NumCalculated ? static_cast<double>(TotalIters) / NumCalculated : 0.0)
+     << " per point, " << (TotalIters ? IterTime / TotalIters : 0.0) << " ns per iteration\n";
+
+  // Many points converging at the end mean that MaxIters cuts off
+  // slow ones, empty end means that it can be lowered.
+  OS << "Iterations to convergence:\n";
+  for (int B = 0; B < HistBuckets; ++B) {
+    int Low = B * MaxIters / HistBuckets + 1;
+    int High = (B + 1) * MaxIters / HistBuckets;
+    if (Low > High)
+      continue;
+    OS << "  " << std::setw(5) << Low << " - " << std::left << std::setw(5) << High
+       << std::right << std::setw(12) << Hist[B] << std::setw(8)
+       << toPercent(Hist[B], NumConverged) << "%\n";
+  }
+  if (NumConverged)
+    OS << "  average " << static_cast<double>(ConvergedIters) / NumConverged << '\n';
+
+  OS.flags(OldFlags);
+  OS.precision(OldPrecision);
+}
+
+// Calculated points go from black (one iteration) through red and
+// yellow to white (MaxIters). NaN exits are blue, points stopped in
+// cycles are green, points which were not calculated are dark gray.
+void RenderProfile::writeHeatmap(const std::string &FileName) const {
+  ImageWriter Writer(FileName, Width, Height, 8);
+  std::vector<std::uint8_t> Row(std::size_t(3) * Width);
+  for (unsigned Y = 0; Y < Height; ++Y) {
+    for (unsigned X = 0; X < Width; ++X) {
+      std::size_t Idx = std::size_t(Y) * Width + X;
+      std::uint8_t *Px = &Row[3 * X];
+      if (!(Flags[Idx] & Calculated)) {
+        Px[0] = Px[1] = Px[2] = 32;
+        continue;
+      }
+      if (Flags[Idx] & NaNExit) {
+        Px[0] = 0;
+        Px[1] = 64;
+        Px[2] = 255;
+        continue;
+      }
+      if (Flags[Idx] & CycleExit) {
+        Px[0] = 0;
+        Px[1] = 160;
+        Px[2] = 64;
+        continue;
+      }
+      // Three segments of 255 levels.
+      int Level = std::min<int>(Iters[Idx], MaxIters) * 765 / MaxIters;
+      Px[0] = static_cast<std::uint8_t>(std::min(Level, 255));
+      Px[1] = static_cast<std::uint8_t>(std::clamp(Level - 255, 0, 255));
+      Px[2] = static_cast<std::uint8_t>(std::clamp(Level - 510, 0, 255));
+    }
+    Writer.writeRow(Row.data());
+  }
+  Writer.finish();
+}
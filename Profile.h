@@ -0,0 +1,93 @@
+#ifndef FRACGEN_PROFILE_H_DEFINED__
+#define FRACGEN_PROFILE_H_DEFINED__
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <cstdint>
+
+// Where render time goes. Collected only if asked by options
+// because timing every point slows rendering down a bit.
+// Times of bootstrap and iterations are summed over all threads,
+// other phases are measured by wall clock. Besides times, number of
+// iterations and the way calculation has ended are kept for every
+// pixel; they are used for summary and cost heatmap.
+class RenderProfile {
+public:
+  enum class Phase {
+    // Opening of cache, compilation of expressions.
+    Setup,
+    // Initial points of method (Steffensen steps) and its construction.
+    Bootstrap,
+    Iterate,
+    // Extra samples of edge pixels.
+    Antialias,
+    // Conversion of points to RGB samples.
+    Colorize,
+    // Writing of image file.
+    Encode,
+  };
+  static constexpr unsigned NumPhases = 6;
+
+private:
+  enum : std::uint8_t {
+    Calculated = 1,
+    Converged = 2,
+    NaNExit = 4,
+    CycleExit = 8,
+  };
+
+  unsigned Width;
+  unsigned Height;
+  int MaxIters;
+  std::array<std::atomic<std::uint64_t>, NumPhases> Times;
+  std::vector<std::uint16_t> Iters;
+  std::vector<std::uint8_t> Flags;
+
+public:
+  RenderProfile(unsigned Width, unsigned Height, int MaxIters);
+
+  RenderProfile(const RenderProfile &) = delete;
+  RenderProfile &operator=(const RenderProfile &) = delete;
+
+  void addTime(Phase P, std::chrono::nanoseconds Time) {
+    Times[static_cast<unsigned>(P)].fetch_add(Time.count(), std::memory_order_relaxed);
+  }
+
+  // Records calculated point. Points which are not recorded were
+  // taken from cache or interpolated. Different pixels can be
+  // recorded concurrently.
+  void setPoint(unsigned X, unsigned Y, int NumIters, bool IsConverged, bool IsNaN,
+                bool IsCycled);
+
+  // Summary of times, outcomes of points and distribution of
+  // iterations to convergence.
+  void printReport(std::ostream &OS) const;
+
+  // Image of number of iterations of every pixel. Throws
+  // std::runtime_error if image can't be written.
+  void writeHeatmap(const std::string &FileName) const;
+};
+
+// Calls Fn and adds its time to phase P of Profile if it is given.
+template<typename FnTy>
+auto timePhase(RenderProfile *Profile, RenderProfile::Phase P, FnTy Fn) -> decltype(Fn()) {
+  struct Timer {
+    RenderProfile *Profile;
+    RenderProfile::Phase P;
+    std::chrono::steady_clock::time_point Start;
+
+    ~Timer() {
+      if (Profile)
+        Profile->addTime(P, std::chrono::steady_clock::now() - Start);
+    }
+  } T{Profile, P, Profile ? std::chrono::steady_clock::now()
+                          : std::chrono::steady_clock::time_point()};
+  return Fn();
+}
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef FRACGEN_RESULT_H_DEFINED__
+#define FRACGEN_RESULT_H_DEFINED__
+
+#include "Color.h"
+#include "Types.h"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <vector>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Point quantized to 16-bit fields: argument from [-pi, pi], norm
+// relative to Epsilon (see PointColor, only norms below Epsilon affect
+// color so larger ones are saturated) and iteration count saturated
+// at 65535. Points which haven't converged have only flags.
+// This is also a record of result cache.
+struct PackedPoint {
+  static constexpr std::uint16_t Converged = 1;
+  // Stopped because point fell into cycle (see CycleDetector).
+  static constexpr std::uint16_t Cycled = 2;
+
+  std::uint16_t Arg;
+  std::uint16_t Norm;
+  std::uint16_t Iters;
+  std::uint16_t Flags;
+
+private:
+  static constexpr FloatType Pi = 3.14159265358979323846;
+  static constexpr std::uint16_t MaxQuant = std::numeric_limits<std::uint16_t>::max();
+
+  static std::uint16_t quantize(FloatType V) {
+    if (!(V > 0.0))
+      return 0;
+    if (V >= 1.0)
+      return MaxQuant;
+    return static_cast<std::uint16_t>(std::lround(V * MaxQuant));
+  }
+
+  static FloatType dequantize(std::uint16_t Q) {
+    return static_cast<FloatType>(Q) / MaxQuant;
+  }
+
+public:
+  static PackedPoint pack(const PtColor &Pt) {
+    if (!Pt.first)
+      return {0, 0, 0, Pt.second.isCycled() ? Cycled : std::uint16_t(0)};
+    return {quantize((Pt.second.getArg() + Pi) / (2.0 * Pi)),
+            quantize(Pt.second.getNorm()),
+            static_cast<std::uint16_t>(std::min<int>(Pt.second.getIters(), MaxQuant)),
+            Converged};
+  }
+
+  bool isConverged() const {
+    return Flags & Converged;
+  }
+
+  bool isCycled() const {
+    return Flags & Cycled;
+  }
+
+  // Valid only for converged points.
+  PointColor getColor() const {
+    return PointColor(dequantize(Arg) * 2.0 * Pi - Pi, dequantize(Norm), Iters);
+  }
+
+  PtColor unpack() const {
+    if (!isConverged())
+      return PtColor(false, isCycled());
+    return PtColor(true, getColor());
+  }
+};
+
+// Rendered image in compact form: convergence and cycle bit masks and
+// quantized argument, norm and iteration count of every converged
+// point, stored as separate arrays in row-major order. Takes a bit more
+// than 6 bytes per pixel instead of 40 bytes of PtColor.
+// Pixels can be set concurrently by different threads.
+class FractalResult {
+public:
+  // Extra points inside of pixel Idx (anti-aliasing). Color of pixel is
+  // averaged over them and point of pixel itself.
+  struct Supersampled {
+    std::size_t Idx;
+    std::vector<PackedPoint> Samples;
+  };
+
+private:
+  using WordTy = std::uint64_t;
+  static constexpr unsigned WordBits = 64;
+
+  unsigned Width;
+  unsigned Height;
+  // Neighbouring pixels may be set from different threads, so
+  // words of mask are updated atomically.
+  std::vector<std::atomic<WordTy>> Converged;
+  std::vector<std::atomic<WordTy>> Cycled;
+  std::vector<std::uint16_t> Args;
+  std::vector<std::uint16_t> Norms;
+  std::vector<std::uint16_t> Iters;
+  // Only few pixels are supersampled, they are kept sorted by index.
+  std::vector<Supersampled> Sampled;
+
+public:
+  FractalResult(unsigned Width, unsigned Height):
+    Width(Width), Height(Height),
+    Converged((std::size_t(Width) * Height + WordBits - 1) / WordBits),
+    Cycled((std::size_t(Width) * Height + WordBits - 1) / WordBits),
+    Args(std::size_t(Width) * Height), Norms(std::size_t(Width) * Height),
+    Iters(std::size_t(Width) * Height) {}
+
+  FractalResult(FractalResult &&) = default;
+  FractalResult &operator=(FractalResult &&) = default;
+
+  unsigned getWidth() const {
+    return Width;
+  }
+
+  unsigned getHeight() const {
+    return Height;
+  }
+
+  std::size_t getIndex(unsigned X, unsigned Y) const {
+    return std::size_t(Y) * Width + X;
+  }
+
+  void set(std::size_t Idx, const PackedPoint &Pt) {
+    if (Pt.isCycled())
+      Cycled[Idx / WordBits].fetch_or(WordTy(1) << Idx % WordBits, std::memory_order_relaxed);
+    if (!Pt.isConverged())
+      return;
+    Converged[Idx / WordBits].fetch_or(WordTy(1) << Idx % WordBits, std::memory_order_relaxed);
+    Args[Idx] = Pt.Arg;
+    Norms[Idx] = Pt.Norm;
+    Iters[Idx] = Pt.Iters;
+  }
+
+  void set(std::size_t Idx, const PtColor &Pt) {
+    set(Idx, PackedPoint::pack(Pt));
+  }
+
+  bool isConverged(std::size_t Idx) const {
+    return Converged[Idx / WordBits].load(std::memory_order_relaxed) >> Idx % WordBits & 1;
+  }
+
+  bool isCycled(std::size_t Idx) const {
+    return Cycled[Idx / WordBits].load(std::memory_order_relaxed) >> Idx % WordBits & 1;
+  }
+
+  PackedPoint getPacked(std::size_t Idx) const {
+    if (!isConverged(Idx))
+      return {0, 0, 0, isCycled(Idx) ? PackedPoint::Cycled : std::uint16_t(0)};
+    return {Args[Idx], Norms[Idx], Iters[Idx], PackedPoint::Converged};
+  }
+
+  // Valid only for converged pixels.
+  PointColor getColor(std::size_t Idx) const {
+    return getPacked(Idx).getColor();
+  }
+
+  void setSupersampled(std::vector<Supersampled> Pixels) {
+    std::sort(Pixels.begin(), Pixels.end(),
+              [](const Supersampled &A, const Supersampled &B) { return A.Idx < B.Idx; });
+    Sampled = std::move(Pixels);
+  }
+
+  // Supersampled pixels with indices not less than Idx.
+  std::vector<Supersampled>::const_iterator getSupersampled(std::size_t Idx) const {
+    return std::lower_bound(Sampled.begin(), Sampled.end(), Idx,
+                            [](const Supersampled &P, std::size_t Idx) { return P.Idx < Idx; });
+  }
+
+  std::vector<Supersampled>::const_iterator getSupersampledEnd() const {
+    return Sampled.end();
+  }
+};
+
+#endif
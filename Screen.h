@@ -0,0 +1,74 @@
+#ifndef FRACGEN_SCREEN_H_DEFINED__
+#define FRACGEN_SCREEN_H_DEFINED__
+
+#include "Result.h"
+
+#include <array>
+#include <tuple>
+
+#include <cmath>
+#include <cstddef>
+
+// Width of low-resolution probe of image. Height keeps aspect ratio.
+constexpr int ScreenSide = 64;
+
+// What probe of image looks like.
+struct ScreenResult {
+  // Share of converged points.
+  double Converged = 0.0;
+  // Shannon entropy of colors of points in bits. Every channel is
+  // quantized to 3 bits, so it is between 0 and 9.
+  double Entropy = 0.0;
+};
+
+// Expressions whose probe is below any of thresholds are rejected:
+// most of them give black or almost uniform images.
+struct ScreenThresholds {
+  double MinConverged = 0.05;
+  double MinEntropy = 1.0;
+
+  bool accepts(const ScreenResult &Res) const {
+    return Res.Converged >= MinConverged && Res.Entropy >= MinEntropy;
+  }
+};
+
+static inline ScreenResult getScreenResult(const FractalResult &Probe) {
+  constexpr unsigned Levels = 8;
+  // Out of range components (NaN included) are clamped as in image.
+  auto Quantize = [](double V) -> unsigned {
+    if (!(V > 0.0))
+      return 0;
+    if (V >= 1.0)
+      return Levels - 1;
+    return static_cast<unsigned>(V * Levels);
+  };
+
+  std::array<std::size_t, Levels * Levels * Levels> Hist = {};
+  std::size_t Total = std::size_t(Probe.getWidth()) * Probe.getHeight();
+  std::size_t NumConverged = 0;
+  for (std::size_t Idx = 0; Idx < Total; ++Idx) {
+    // Points which didn't converge are black.
+    if (!Probe.isConverged(Idx)) {
+      ++Hist[0];
+      continue;
+    }
+    ++NumConverged;
+    auto RGB = Probe.getColor(Idx).getRGB();
+    ++Hist[(Quantize(std::get<0>(RGB)) * Levels + Quantize(std::get<1>(RGB))) * Levels +
+           Quantize(std::get<2>(RGB))];
+  }
+
+  ScreenResult Res;
+  if (!Total)
+    return Res;
+  Res.Converged = static_cast<double>(NumConverged) / Total;
+  for (std::size_t Count : Hist) {
+    if (!Count)
+      continue;
+    double P = static_cast<double>(Count) / Total;
+    Res.Entropy -= P * std::log2(P);
+  }
+  return Res;
+}
+
+#endif
@@ -0,0 +1,44 @@
+#!/usr/bin/ruby2.3
+
+# Configures sources with default parameters of frac-gen.rb, builds
+# Bench and runs it. Used by 'make bench'.
+
+require 'erb'
+require 'optparse'
+
+options = {json: "bench.json", threads: 1}
+OptionParser.new do |opts|
+  opts.on("-o", "--json FILE", "Write results to FILE") { |v| options[:json] = v }
+  opts.on("-j", "--threads N", "Number of threads (0 -- all cores)") { |v| options[:threads] = v }
+  opts.on("-i", "--iters I", "Specify number of iterations") { |v| options[:iters] = v }
+  opts.on("-e", "--epsilon E", "Specify accuracy of calculation") { |v| options[:epsilon] = v }
+  opts.on("-n", "--norm N", "Specify used metric norm") { |v| options[:norm] = v }
+  opts.on("-p", "--precision P", "Precision of SIMD lanes (double, float or mixed)") do |v|
+    options[:precision] = v
+  end
+end.parse!
+
+Dir.chdir(File.join(File.dirname(__FILE__), ".."))
+
+# Only MaxIters, Epsilon, norm and precision of SIMD lanes (used by
+# batches of batchable methods) matter for benchmark. Norm and precision
+# are compiled in, the others are passed to Bench.
+epsilon = options[:epsilon] || 0.05
+norm = options[:norm] || "norm2"
+iters = options[:iters] || 25
+precision = (options[:precision] || "double").capitalize
+unless ["Double", "Float", "Mixed"].include?(precision)
+  fail "Unknown precision '#{options[:precision]}', expected one of double, float, mixed"
+end
+
+["Config.raw.h", "Norm.X.raw.h"].each do |raw|
+  File.open(raw.sub(".raw", ""), "w") do |f|
+    f << ERB.new(File.read(raw)).result(binding)
+  end
+end
+
+system("make", "Bench") or fail "Can't build benchmark"
+system("./Bench", "--threads=#{options[:threads]}", "--iters=#{iters}", "--epsilon=#{epsilon}",
+       "--json=#{options[:json]}") or
+  fail "Benchmark failed"
+puts "Results are written to #{options[:json]}"
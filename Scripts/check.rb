@@ -0,0 +1,92 @@
+#!/usr/bin/ruby2.3
+
+# Checks that --stop-cycles only stops points which don't converge:
+# every case is rendered with and without it and each pixel converged
+# without it must stay converged with the same color with it. Cases cover
+# iteration paths which restart scalar iterations from the middle of
+# orbit (deep zoom and recheck of mixed precision lanes). Used by
+# 'make check'.
+
+require 'erb'
+
+require_relative 'exprcode'
+
+Dir.chdir(File.join(File.dirname(__FILE__), ".."))
+
+EXPR = "return Pt * Pt * Pt - 1.0;"
+EXPR_DIFF = "return 3.0 * Pt * Pt;"
+IMAGE = "FracGenCheck.ppm"
+
+CASES = [
+  {name: "scalar", deep_zoom: false, precision: "Double", batch_width: "0",
+   args: ["--scale=100", "--iters=200"]},
+  {name: "simd", deep_zoom: false, precision: "Double", batch_width: "DefaultLanes<IterFloatType>",
+   args: ["--scale=100", "--iters=200"]},
+  # Float lanes of mixed precision can't get below epsilon of 1e-8 and
+  # stall near root until rounding lets them through. With --stop-cycles
+  # such lanes are verified in double at once, so they converge in fewer
+  # iterations: only their convergence is checked.
+  {name: "mixed", deep_zoom: false, precision: "Mixed", batch_width: "DefaultLanes<IterFloatType>",
+   args: ["--scale=100", "--iters=200", "--epsilon=1e-8"], recolor: true},
+  {name: "deep", deep_zoom: true, precision: "Double", batch_width: "0",
+   args: ["--x-center=-0.7937005259840998", "--scale=1e12", "--iters=200"]},
+]
+
+# Pixels of binary PPM written by FracGen.
+def read_ppm(file)
+  data = File.binread(file)
+  fail "#{file} is not binary PPM" unless data =~ /\AP6\n(\d+) (\d+)\n255\n/
+  data[$~[0].size..-1].unpack("C*").each_slice(3).to_a
+end
+
+# In gray palette converged points are gray, cycled ones are bluish.
+def converged?(px)
+  px[0] > 0 && px[0] == px[1] && px[1] == px[2]
+end
+
+def render(args)
+  system("./FracGen", "--width=300", "--height=300", "--no-tone-map", "--palette=gray",
+         "--output=#{IMAGE}", *args) or fail "FracGen failed"
+  read_ppm(IMAGE)
+end
+
+method = "Newton"
+expr = EXPR
+expr_diff = EXPR_DIFF
+code = ExprCode.codegen(expr, expr_diff)
+expr_code = code[:fn]
+expr_diff_code = code[:diff]
+expr_fused_code = code[:fused]
+norm = "norm2"
+
+failed = false
+CASES.each do |c|
+  deep_zoom = c[:deep_zoom]
+  precision = c[:precision]
+  batch_width = c[:batch_width]
+  ["Config.raw.h", "Norm.X.raw.h", "FracMath.raw.cpp"].each do |raw|
+    File.write(raw.sub(".raw", ""), ERB.new(File.read(raw)).result(binding))
+  end
+  system("make", "FracGen") or fail "Can't build FracGen"
+
+  plain = render(c[:args])
+  stopped = render(c[:args] + ["--stop-cycles"])
+  converged = 0
+  lost = 0
+  recolored = 0
+  plain.each_with_index do |px, i|
+    next unless converged?(px)
+    converged += 1
+    if !converged?(stopped[i])
+      lost += 1
+    elsif stopped[i] != px
+      recolored += 1
+    end
+  end
+  puts "#{c[:name]}: #{converged} converged pixels, #{lost} lost and #{recolored} recolored " \
+       "by --stop-cycles"
+  failed ||= lost > 0 || (recolored > 0 && !c[:recolor])
+end
+File.delete(IMAGE)
+
+fail "--stop-cycles changed converged points" if failed
@@ -11,6 +11,7 @@ module Config
                     "Method parameters" => :method_params,
                     "Epsilon" => :epsilon,
                     "Norm" => :norm,
+                    "Precision" => :precision,
                     "Scale" => :scale,
                     "Iterations" => :iters,
                     "X of center" => :c_x,
@@ -47,6 +48,12 @@ module Config
       line = @file.gets
       loop do
         break if line.nil?
+        # Expression rejected by screening is kept only to reproduce generation.
+        if line.rstrip == "--- REJECTED ---"
+          line = @file.gets
+          line = @file.gets until line.nil? || section_start?(line)
+          next
+        end
         fail "Bad expression" if line.rstrip != "--- EXPR ---"
 
         # Num: num
@@ -72,7 +79,7 @@ module Config
 
         # Diff expr: expr
         diff_expr = ""
-        while !line.start_with?("--- EXPR ---")
+        while !section_start?(line)
           diff_expr += line
           line = @file.gets
           break if line.nil?
@@ -94,6 +101,7 @@ module Config
       @file.puts("Method parameters: #{method_params}")
       @file.puts("Epsilon: #{opts.fetch(:epsilon)}")
       @file.puts("Norm: #{opts.fetch(:norm)}")
+      @file.puts("Precision: #{opts.fetch(:precision)}")
       @file.puts("Scale: #{opts.fetch(:scale)}")
       @file.puts("Iterations: #{opts.fetch(:iters)}")
       @file.puts("X of center: #{opts.fetch(:c_x)}")
@@ -103,6 +111,12 @@ module Config
       @file.puts("--- HEADER ---")
     end
 
+    # FracGen reads only expressions from config.
+    def save_empty_header
+      @file.puts("--- HEADER ---")
+      @file.puts("--- HEADER ---")
+    end
+
     def save_expr(num:, expr:, diff_expr:)
       @file.puts("--- EXPR ---")
       @file.puts("Num: #{num}")
@@ -110,10 +124,29 @@ module Config
       @file.puts("Diff expr: #{diff_expr}")
     end
 
+    # Expression that was generated but not rendered.
+    def save_rejected(num:, expr:, diff_expr:, reason:)
+      @file.puts("--- REJECTED ---")
+      @file.puts("Num: #{num}")
+      @file.puts("Reason: #{reason}")
+      @file.puts("Expr: #{expr}")
+      @file.puts("Diff expr: #{diff_expr}")
+    end
+
+    def flush
+      @file.flush
+    end
+
     def close
       @file.close
     end
 
+    private
+
+    def section_start?(line)
+      line.start_with?("--- EXPR ---") || line.start_with?("--- REJECTED ---")
+    end
+
   end # class Config
 
 end # module Config
@@ -0,0 +1,337 @@
+require 'strscan'
+
+# Optimization of generated expressions. Expression (what is put into
+# body of Fn: 'return <expr>;') is parsed into DAG where equal
+# subexpressions are the same node, simplified and emitted back either
+# as single expression (for config and interpreter) or as body with
+# temporaries for compiled FracGen (see FracMath.raw.cpp).
+module ExprCode
+
+  class ParseError < StandardError
+  end
+
+  # Kind is :real, :complex or :bool like in interpreter (Expr.cpp),
+  # so simplified expression has the same types as original one.
+  class Node
+    attr_reader :op, :text, :args, :kind, :value
+
+    def initialize(op, text, args, kind, value = nil)
+      @op = op
+      @text = text
+      @args = args
+      @kind = kind
+      @value = value
+      @const = op != :pt && args.all?(&:const?)
+    end
+
+    # Doesn't depend on Pt.
+    def const?
+      @const
+    end
+
+    def num?(val = nil)
+      @op == :num && (val.nil? || @value == val)
+    end
+
+    # Real zero or ValType(0.0).
+    def zero?
+      num?(0) || (literal? && @args.size == 1 && @args[0].num?(0))
+    end
+
+    def leaf?
+      @op == :pt || @op == :num || literal?
+    end
+
+    # ValType(a, b) with number arguments.
+    def literal?
+      @op == :call && @text == "ValType" && @args.all?(&:num?)
+    end
+
+    def to_s(names = {})
+      return names[self] if names[self]
+      ops = @args.map { |a| a.to_s(names) }
+      case @op
+      when :pt, :num
+        @text
+      when :call
+        "#{@text}(#{ops.join(", ")})"
+      when :neg
+        "(-#{ops[0]})"
+      when :not
+        "(!#{ops[0]})"
+      when :bin
+        "(#{ops[0]} #{@text} #{ops[1]})"
+      when :tern
+        "((#{ops[0]}) ? (#{ops[1]}) : (#{ops[2]}))"
+      end
+    end
+  end
+
+  ARITH = ["+", "-", "*", "/"]
+  REAL_FUNCS = ["std::abs", "abs", "fabs"]
+
+  # Creates nodes. Every node is created once, so equal subexpressions
+  # are equal objects. Constant real numbers are folded, and operations
+  # with 0, 1 and -1 are simplified as long as kind of result stays the
+  # same and result is the same for every value of other operand.
+  class Builder
+    def initialize
+      @nodes = {}
+    end
+
+    def intern(op, text, args, kind, value = nil)
+      key = [op, text, args.map(&:object_id)]
+      @nodes[key] ||= Node.new(op, text, args, kind, value)
+    end
+
+    def pt
+      intern(:pt, "Pt", [], :complex)
+    end
+
+    # Complex zero is ValType(0.0).
+    def num(value, kind = :real)
+      if kind == :complex
+        return call("ValType", [num(value)])
+      end
+      intern(:num, value.to_s, [], :real, value)
+    end
+
+    def parsed_num(text)
+      value = Float(text)
+      intern(:num, text, [], :real, value)
+    end
+
+    def call(name, args)
+      kind = if name == "ValType"
+               :complex
+             elsif REAL_FUNCS.include?(name)
+               :real
+             elsif args.any? { |a| a.kind == :complex }
+               :complex
+             else
+               :real
+             end
+      intern(:call, name, args, kind)
+    end
+
+    def neg(a)
+      return num(-a.value) if a.num?
+      return a.args[0] if a.op == :neg
+      intern(:neg, "-", [a], a.kind)
+    end
+
+    def not(a)
+      intern(:not, "!", [a], :bool)
+    end
+
+    def tern(c, a, b)
+      kind = a.kind == :complex || b.kind == :complex ? :complex : a.kind
+      intern(:tern, "?", [c, a, b], kind)
+    end
+
+    def bin(op, a, b)
+      unless ARITH.include?(op)
+        return intern(:bin, op, [a, b], :bool)
+      end
+
+      kind = a.kind == :complex || b.kind == :complex ? :complex : :real
+      if a.num? && b.num?
+        value = a.value.send(op, b.value)
+        return num(value) if value.finite?
+      end
+      # Identity is dropped only if it doesn't change kind of result.
+      # x - x, 0 * x and 0 / x aren't 0 for infinite or NaN x, and x + 0
+      # and 0 - x can change sign of zero, so they are kept.
+      same = ->(x) { x.kind == kind ? x : nil }
+      res = case op
+            when "-"
+              b.zero? && same[a]
+            when "*"
+              (b.num?(1) && same[a]) || (a.num?(1) && same[b]) ||
+                (b.num?(-1) && same[a] && neg(a)) || (a.num?(-1) && same[b] && neg(b))
+            when "/"
+              (b.num?(1) && same[a]) || (b.num?(-1) && same[a] && neg(a))
+            end
+      res || intern(:bin, op, [a, b], kind)
+    end
+  end
+
+  # Recursive descent parser of what ExprTree generates. Grammar and
+  # precedence are the same as of interpreter.
+  class Parser
+    NUMBER = /(\d+\.?\d*|\.\d+)([eE][+-]?\d+)?/
+    IDENT = /(std::)?[A-Za-z_]\w*/
+
+    def initialize(builder, src)
+      @b = builder
+      src = src.strip
+      src = src.sub(/\Areturn\s+/, "").sub(/;\s*\z/, "")
+      @s = StringScanner.new(src)
+    end
+
+    def parse
+      res = ternary
+      skip
+      fail ParseError, "Unexpected '#{@s.rest[0, 20]}'" unless @s.eos?
+      res
+    end
+
+    private
+
+    def skip
+      @s.skip(/\s+/)
+    end
+
+    def consume(tok)
+      skip
+      !@s.scan(Regexp.new(Regexp.escape(tok))).nil?
+    end
+
+    def expect(tok)
+      fail ParseError, "Expected '#{tok}' at '#{@s.rest[0, 20]}'" unless consume(tok)
+    end
+
+    def ternary
+      cond = binary(0)
+      return cond unless consume("?")
+      a = ternary
+      expect(":")
+      @b.tern(cond, a, ternary)
+    end
+
+    LEVELS = [["||"], ["&&"], ["==", "!="], ["<=", ">=", "<", ">"], ["+", "-"], ["*", "/"]]
+
+    def binary(level)
+      return unary if level == LEVELS.size
+      res = binary(level + 1)
+      loop do
+        skip
+        op = LEVELS[level].find { |o| @s.match?(Regexp.new(Regexp.escape(o))) }
+        break if op.nil?
+        # '<' of '<=' and '-' of negative exponent are handled by order and NUMBER.
+        @s.pos += op.size
+        res = @b.bin(op, res, binary(level + 1))
+      end
+      res
+    end
+
+    def unary
+      return @b.neg(unary) if consume("-")
+      return unary if consume("+")
+      return @b.not(unary) if consume("!")
+      primary
+    end
+
+    def primary
+      skip
+      if consume("(")
+        res = ternary
+        expect(")")
+        return res
+      end
+      if (num = @s.scan(NUMBER))
+        return @b.parsed_num(num)
+      end
+      name = @s.scan(IDENT)
+      fail ParseError, "Expected expression at '#{@s.rest[0, 20]}'" if name.nil?
+      return @b.pt if name == "Pt"
+      expect("(")
+      args = []
+      unless consume(")")
+        begin
+          args << ternary
+        end while consume(",")
+        expect(")")
+      end
+      @b.call(name, args)
+    end
+  end
+
+  def self.parse(builder, src)
+    Parser.new(builder, src).parse
+  end
+
+  # Simplified expression in form accepted by FracGen, or src itself
+  # if it can't be parsed (e.g. 'abort(); ...' of missing expression).
+  def self.simplify(src)
+    "return #{parse(Builder.new, src).to_s};"
+  rescue ParseError
+    src
+  end
+
+  # Bodies of compiled functions: {fn:, diff:, fused:}. fused returns
+  # value and derivative together and is nil if diff is missing or
+  # expression has conditionals (both branches would be evaluated).
+  # Constant subexpressions are named and left to compiler, which folds
+  # them (calls of library functions too, correctly rounded). Static
+  # constants would be calculated at runtime and could differ in last
+  # bits. Subexpressions used several times are kept in temporaries.
+  def self.codegen(src, diff_src)
+    b = Builder.new
+    fn = parse(b, src)
+    diff = begin
+             parse(b, diff_src)
+           rescue ParseError
+             nil
+           end
+    res = {fn: emit([fn]), diff: diff ? emit([diff]) : diff_src}
+    res[:fused] = emit([fn, diff]) if diff && !has_tern?(fn) && !has_tern?(diff)
+    res
+  rescue ParseError
+    {fn: src, diff: diff_src, fused: nil}
+  end
+
+  def self.has_tern?(node)
+    node.op == :tern || node.args.any? { |a| has_tern?(a) }
+  end
+
+  # Body that returns roots (one as value, two as pair).
+  def self.emit(roots)
+    uses = Hash.new(0)
+    order = []
+    count = lambda do |n|
+      uses[n] += 1
+      return if uses[n] > 1
+      n.args.each { |a| count[a] }
+      order << n
+    end
+    roots.each { |r| count[r] }
+
+    # Conditionals evaluate only one branch, so nothing under them is
+    # moved out except constants.
+    under_tern = {}
+    mark = lambda do |n, cond|
+      return if under_tern[n] == false || (cond && under_tern.key?(n))
+      under_tern[n] = cond
+      n.args.each_with_index { |a, i| mark[a, cond || (n.op == :tern && i > 0)] }
+    end
+    roots.each { |r| mark[r, false] }
+
+    # Constants are named only where they are used by something else.
+    named_const = {}
+    roots.each { |r| named_const[r] = true }
+    order.each do |n|
+      n.args.each { |a| named_const[a] = true if !n.const? || uses[a] > 1 }
+    end
+
+    names = {}
+    lines = []
+    order.each do |n|
+      next if n.leaf?
+      if n.const? && named_const[n] && n.kind != :bool
+        name = "C#{names.size}"
+        lines << "const auto #{name} = #{n.to_s(names)};"
+      elsif uses[n] > 1 && !under_tern[n] && n.kind != :bool
+        name = "T#{names.size}"
+        lines << "const auto #{name} = #{n.to_s(names)};"
+      else
+        next
+      end
+      names[n] = name
+    end
+    ret = roots.map { |r| r.to_s(names) }
+    lines << (roots.size == 1 ? "return #{ret[0]};" : "return {#{ret.join(", ")}};")
+    lines.join("\n      ")
+  end
+
+end # module ExprCode
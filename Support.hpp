@@ -7,6 +7,7 @@
 #include <array>
 
 #include <cassert>
+#include <cstdint>
 
 template<typename T, T Num, typename = std::enable_if_t<std::is_integral_v<T>, void>>
 constexpr T nextPow2() {
@@ -18,6 +19,38 @@ constexpr T nextPow2() {
   return Res;
 }
 
+// SplitMix64 finalizer. Scatters even close inputs over whole range.
+constexpr std::uint64_t mixBits(std::uint64_t X) {
+  X = (X ^ (X >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  X = (X ^ (X >> 27)) * 0x94d049bb133111ebULL;
+  return X ^ (X >> 31);
+}
+
+// Seed of single pixel. Depends only on image seed and pixel coordinates
+// so result does not depend on order in which pixels are visited.
+constexpr std::uint64_t getPixelSeed(std::uint64_t ImageSeed, int X, int Y) {
+  std::uint64_t Seed = mixBits(ImageSeed + 0x9e3779b97f4a7c15ULL);
+  Seed = mixBits(Seed ^ static_cast<std::uint32_t>(X));
+  return mixBits(Seed ^ (static_cast<std::uint64_t>(static_cast<std::uint32_t>(Y)) << 32));
+}
+
+// SplitMix64 generator. Its state is single word so every point can have one.
+class SplitMix64 {
+  std::uint64_t State;
+
+public:
+  using result_type = std::uint64_t;
+
+  explicit SplitMix64(std::uint64_t Seed): State(Seed) {}
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return ~result_type(0); }
+
+  result_type operator()() {
+    return mixBits(State += 0x9e3779b97f4a7c15ULL);
+  }
+};
+
 // Specialized always full circular buffer.
 template<typename T, IdxType Size>
 class CircularBuffer {
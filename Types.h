@@ -6,6 +6,27 @@
 using FloatType = double;
 using ValType = std::complex<FloatType>;
 
+// Center of view is kept in it, so deep zoom can go past precision
+// of FloatType (see Deep.hpp). 64 bits of mantissa on x86.
+using DeepFloatType = long double;
+
 using IdxType = unsigned;
 
+// Precision of points iterated in SIMD lanes (see getPointIndexBatch),
+// chosen by Config.h. Float fits twice as many lanes into vector
+// register. Mixed iterates in float too, but points that converged are
+// checked (and iterated further if needed) in double and points that
+// overflowed float are calculated again in double. Everything else,
+// including scalar iterations, viewport and colors, is in FloatType.
+enum class Precision { Double, Float, Mixed };
+
+// Point is iterated until norm of function at it is below Epsilon
+// (converged) or MaxIters iterations are made. If StopCycles is set,
+// points that fell into cycle or stalled are stopped earlier.
+struct IterLimits {
+  int MaxIters = 25;
+  FloatType Epsilon = 0.05;
+  bool StopCycles = false;
+};
+
 #endif
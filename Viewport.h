@@ -0,0 +1,33 @@
+#ifndef FRACGEN_VIEWPORT_H_DEFINED__
+#define FRACGEN_VIEWPORT_H_DEFINED__
+
+#include "Types.h"
+
+// Part of complex plane covered by image. Center is in DeepFloatType
+// for deep zoom, coordinates of pixels are rounded to FloatType.
+struct Viewport {
+  DeepFloatType CX;
+  DeepFloatType CY;
+  FloatType Scale;
+  unsigned Width;
+  unsigned Height;
+
+  // Distance from center to pixel.
+  FloatType getOffsetX(int Col) const {
+    return static_cast<FloatType>(Col - static_cast<int>(Width) / 2) / Scale;
+  }
+
+  FloatType getOffsetY(int Row) const {
+    return static_cast<FloatType>(Row - static_cast<int>(Height) / 2) / Scale;
+  }
+
+  FloatType getX(int Col) const {
+    return getOffsetX(Col) + static_cast<FloatType>(CX);
+  }
+
+  FloatType getY(int Row) const {
+    return getOffsetY(Row) + static_cast<FloatType>(CY);
+  }
+};
+
+#endif
@@ -5,8 +5,13 @@ require 'optparse'
 require 'pp'
 require 'erb'
 require 'fileutils'
+require 'etc'
+require 'tmpdir'
+require 'digest'
+require 'thread'
 
 require_relative 'Scripts/exprtree'
+require_relative 'Scripts/exprcode'
 require_relative 'Scripts/config'
 
 options = {}
@@ -25,6 +30,31 @@ OptionParser.new do |opts|
   opts.on("", "--y-center Y", "Specify Y coordinate of center") { |v| options[:c_y] = v }
   opts.on("-x", "--length L", "Specify image length in pixels") { |v| options[:xlen] = v }
   opts.on("-y", "--height H", "Specify image height in pixels") { |v| options[:ylen] = v }
+  opts.on("-j", "--threads N", "Number of render threads (0 -- all cores)") { |v| options[:threads] = v }
+  opts.on("-r", "--interpret", "Interpret expressions instead of compiling each of them") { |v| options[:interpret] = true }
+  opts.on("-M", "--modules DIR", "Compile expressions into shared objects cached in DIR and render them by one FracGen") { |v| options[:modules] = v }
+  opts.on("-v", "--simd", "Iterate several points at once with SIMD where possible") { |v| options[:simd] = true }
+  opts.on("-Z", "--deep", "Deep zoom: iterate pixels relative to orbit of center in extended precision") { |v| options[:deep] = true }
+  opts.on("-P", "--precision P", "Precision of SIMD iterations: double, float or mixed") { |v| options[:precision] = v }
+  opts.on("-b", "--band ROWS", "Render and write image by bands of rows to save memory") { |v| options[:band] = v }
+  opts.on("-k", "--cache DIR", "Keep results of points in DIR to reuse them for the same expression") { |v| options[:cache] = v }
+  opts.on("-O", "--stop-cycles", "Stop points that fall into cycles early and draw them in dim color") { |v| options[:stop_cycles] = true }
+  opts.on("-p", "--adaptive", "Don't calculate every point of uniform areas (for previews)") { |v| options[:adaptive] = true }
+  opts.on("-A", "--antialias N", "Anti-alias edges of basins with N extra samples per edge pixel") { |v| options[:antialias] = v }
+  opts.on("-C", "--palette NAME", "Palette of image: classic, rainbow or gray") { |v| options[:palette] = v }
+  opts.on("--no-tone-map", "Don't stretch levels of image by its histogram") { |v| options[:no_tone_map] = true }
+  opts.on("-B", "--batch N", "Render every N generated expressions by one FracGen process (implies --interpret)") { |v| options[:batch] = v }
+  opts.on("-w", "--workers N", "Render N expressions at once, each in its own scratch directory") { |v| options[:workers] = v }
+  opts.on("-S", "--screen", "Render small probe of every generated expression first and skip dull ones") { |v| options[:screen] = true }
+  opts.on("", "--min-converged F", "Minimal share of converged points of probe") { |v| options[:min_converged] = v }
+  opts.on("", "--min-entropy E", "Minimal entropy of colors of probe in bits") { |v| options[:min_entropy] = v }
+  opts.on("-F", "--frames N", "Render zoom or pan sequence of N frames instead of single image") { |v| options[:frames] = v }
+  opts.on("", "--end-x-center X", "X coordinate of center of last frame") { |v| options[:end_c_x] = v }
+  opts.on("", "--end-y-center Y", "Y coordinate of center of last frame") { |v| options[:end_c_y] = v }
+  opts.on("", "--end-scale S", "Scale of last frame") { |v| options[:end_scale] = v }
+  opts.on("", "--video", "Write frames as one stream of PPM images instead of numbered PNG files") { |v| options[:video] = true }
+  opts.on("-t", "--profile", "Print times of render phases and statistics of iterations") { |v| options[:profile] = true }
+  opts.on("", "--heatmap", "Also save image of iterations of every pixel") { |v| options[:heatmap] = true }
 end.parse!
 
 FRACMATH_FILE = 'FracMath.raw.cpp'
@@ -39,6 +69,8 @@ DEFAULT_C_Y = 0.0
 DEFAULT_XLEN = 1000
 DEFAULT_YLEN = 1000
 DEFAULT_NORM = "norm2"
+DEFAULT_PRECISION = "double"
+PRECISIONS = ["double", "float", "mixed"]
 
 DEFAULT_EXPR = "abort(); return 0.0;"
 
@@ -66,12 +98,25 @@ def reproduce_exprs_mode(cfg_opts, exprs, opts)
     method += "<#{params}>"
   end
 
-  exprs.each do |e|
-    generate_image(method, e[:expr], e[:diff_expr])
+  # FracGen renders sequence only for single expression.
+  if $interpret && $frames == 0
+    # All expressions are rendered by single FracGen process.
+    build_fracgen(method, nil, nil)
+    system("./FracGen", *fracgen_opts, "--config=#{opts[:cfg]}")
+    store_batch_images(exprs, dir)
+    return
+  end
+
+  if $workers > 1
+    with_workers(method, dir, ->(e) {}) do |queue|
+      exprs.each { |e| queue << e }
+    end
+    return
+  end
 
-    fi = "FractalImage#{e[:num]}.png"
-    File.rename("FractalImage.png", fi)
-    FileUtils.mv(fi, dir)
+  exprs.each do |e|
+    generate_image(method, e[:expr], e[:diff_expr], e[:num])
+    store_image(e[:num], dir)
   end
 end
 
@@ -118,6 +163,7 @@ end
 def fill_missed_opts(opts)
   opts[:epsilon] ||= DEFAULT_EPSILON
   opts[:norm] ||= DEFAULT_NORM
+  opts[:precision] ||= DEFAULT_PRECISION
   opts[:scale] ||= DEFAULT_SCALE
   opts[:iters] ||= DEFAULT_ITERS
   opts[:c_x] ||= DEFAULT_C_X
@@ -126,25 +172,29 @@ def fill_missed_opts(opts)
   opts[:ylen] ||= DEFAULT_YLEN
 end
 
+# Writes file only if its contents change, so make doesn't rebuild
+# objects that depend on it.
+def write_if_changed(file, contents)
+  return if File.exist?(file) && File.read(file) == contents
+  File.write(file, contents)
+end
+
+# Only norm and precision are compiled in, the rest of image parameters
+# are passed to FracGen by $image_opts.
 def configure_sources(opts)
-  epsilon = opts[:epsilon]
   norm = opts[:norm]
-  scale = opts[:scale]
-  iters = opts[:iters]
-  c_x = opts[:c_x]
-  c_y = opts[:c_y]
-  xlen = opts[:xlen]
-  ylen = opts[:ylen]
-
-  file = CONFIG_FILE.sub(".raw", "")
-  File.open(file, "w") do |f|
-    f << ERB.new(File.read(CONFIG_FILE)).result(binding)
+  unless PRECISIONS.include?(opts[:precision])
+    fail "Unknown precision '#{opts[:precision]}', expected one of #{PRECISIONS.join(", ")}"
   end
+  precision = opts[:precision].capitalize
 
-  file = NORM_FILE.sub(".raw", "")
-  File.open(file, "w") do |f|
-    f << ERB.new(File.read(NORM_FILE)).result(binding)
-  end
+  write_if_changed(CONFIG_FILE.sub(".raw", ""), ERB.new(File.read(CONFIG_FILE)).result(binding))
+  write_if_changed(NORM_FILE.sub(".raw", ""), ERB.new(File.read(NORM_FILE)).result(binding))
+
+  $image_opts = ["--x-center=#{opts[:c_x]}", "--y-center=#{opts[:c_y]}",
+                 "--scale=#{opts[:scale]}", "--width=#{opts[:xlen]}", "--height=#{opts[:ylen]}",
+                 "--iters=#{opts[:iters]}", "--epsilon=#{opts[:epsilon]}"]
+  $screen_iters = [opts[:iters].to_i, SCREEN_ITERS].min
 end
 
 # TODO: unite with produce_with_cfg_mode somehow.
@@ -250,48 +300,355 @@ def wrap_expr(expr)
   end
 end
 
+# Generates random expression and its derivative if method needs it.
+# Returns nil if generated expression is bad.
+def next_expr(need_diff, num)
+  begin
+    expr_tree = ExprTree::Expr.new
+    expr_tree_diff = expr_tree.diff if need_diff
+  rescue ExprTree::BadExpr => e
+    return nil
+  end
+  expr = ExprCode.simplify(wrap_expr(expr_tree.to_s))
+  if need_diff
+    expr_diff = expr_tree_diff.to_s
+  else
+    expr_diff = nil
+  end
+  expr_diff = ExprCode.simplify(wrap_expr(expr_diff))
+
+  puts expr
+  puts expr_diff
+  {num: num, expr: expr, diff_expr: expr_diff}
+end
+
 def produce(dir, method, need_diff, num, cfg)
+  build_screener(method) if $screen
+  on_rejected = lambda do |e, reason|
+    puts "Rejected: #{reason}"
+    cfg.save_rejected(**e, reason: reason)
+  end
+
+  if $workers > 1
+    # Expressions are saved when their images are done.
+    on_done = ->(e) { cfg.save_expr(**e); cfg.flush }
+    with_workers(method, dir, on_done, on_rejected) do |queue|
+      loop do
+        break if $stop
+        e = next_expr(need_diff, num)
+        next if e.nil?
+        queue << e
+        num += 1
+      end
+    end
+    return
+  end
+
+  batch = []
   loop do
     break if $stop
-    begin
-      expr_tree = ExprTree::Expr.new
-      expr_tree_diff = expr_tree.diff if need_diff
-    rescue ExprTree::BadExpr => e
+    e = next_expr(need_diff, num)
+    next if e.nil?
+    num += 1
+    if $screen && (reason = screen_expr(e))
+      on_rejected.call(e, reason)
       next
     end
-    expr = wrap_expr(expr_tree.to_s)
-    if need_diff
-      expr_diff = expr_tree_diff.to_s
+    cfg.save_expr(**e)
+
+    if $batch > 0
+      batch << e
+      if batch.size == $batch
+        generate_batch(method, batch)
+        store_batch_images(batch, dir)
+        batch = []
+      end
     else
-      expr_diff = nil
+      generate_image(method, e[:expr], e[:diff_expr], e[:num])
+      store_image(e[:num], dir)
     end
-    expr_diff = wrap_expr(expr_diff)
+  end
+end
 
-    puts expr
-    puts expr_diff
-    cfg.save_expr(num: num, expr: expr, diff_expr: expr_diff)
+# FracGen used for screening is built once in its own directory, because
+# FracMath.cpp in working directory is rebuilt for every expression.
+def build_screener(method)
+  $screen_dir = make_worker_dir
+  at_exit { FileUtils.rm_rf($screen_dir) }
+  build_fracgen(method, nil, nil, $screen_dir)
+end
 
-    generate_image(method, expr, expr_diff)
+SCREEN_REJECTED = 3
+# Probe needs only to tell dead images from live ones, not their detail.
+SCREEN_ITERS = 25
+
+# Probe of expression is rendered by interpreter, so nothing is compiled
+# for rejected expressions. Only successful probe accepts expression:
+# failed one (bad expression, crash) rejects it too. Returns reason of
+# rejection or nil.
+def screen_expr(e)
+  args = [File.join($screen_dir, "FracGen"), "--screen", *$image_opts,
+          "--iters=#{$screen_iters}", "--threads=#{$threads}", "--seed=#{e[:num]}",
+          "--expr=#{e[:expr]}", "--diff-expr=#{e[:diff_expr]}"]
+  args << "--min-converged=#{$min_converged}" if $min_converged
+  args << "--min-entropy=#{$min_entropy}" if $min_entropy
+  probe = IO.popen(args, err: [:child, :out], &:read).strip
+  status = $?.exitstatus
+  return nil if status == 0
+  return probe if status == SCREEN_REJECTED
+  # Reason is logged and kept in config, so it takes one line.
+  failure = status ? "exit code #{status}" : "signal #{$?.termsig}"
+  "probe failed with #{failure}: #{probe.gsub(/\s*\n\s*/, "; ")}"
+end
 
-    fi = "FractalImage#{num}.png"
-    File.rename("FractalImage.png", fi)
-    FileUtils.mv(fi, dir)
+# Scratch directory of worker: links to sources, its own FracMath.cpp,
+# objects, FracGen and images.
+def make_worker_dir
+  wdir = Dir.mktmpdir("frac-gen-worker")
+  sources = Dir.glob("*.{h,hpp,cpp}") + ["Makefile"] - [FRACMATH_FILE.sub(".raw", "")]
+  sources.each do |f|
+    FileUtils.ln_s(File.expand_path(f), File.join(wdir, f))
+  end
+  wdir
+end
 
-    num += 1
+# Renders expressions pushed by block into queue by $workers threads,
+# every one has its own scratch directory and FracGen process. When
+# image is moved into dir, on_done is called with its expression.
+# Expressions rejected by screening (if it is on) are passed to
+# on_rejected with reason. Callbacks are called under lock, so results
+# may be streamed into one config.
+def with_workers(method, dir, on_done, on_rejected = nil)
+  if $interpret || $modules
+    # All workers run the same FracGen.
+    build_fracgen(method, nil, nil)
+    $fracgen_built = true
+  end
+
+  queue = SizedQueue.new($workers)
+  lock = Mutex.new
+  threads = Array.new($workers) do
+    Thread.new do
+      Thread.current.abort_on_exception = true
+      wdir = make_worker_dir
+      begin
+        while (e = queue.pop)
+          if on_rejected && $screen && (reason = screen_expr(e))
+            lock.synchronize { on_rejected.call(e, reason) }
+            next
+          end
+          generate_image(method, e[:expr], e[:diff_expr], e[:num], wdir)
+          lock.synchronize do
+            store_image(e[:num], dir, wdir)
+            on_done.call(e)
+          end
+        end
+      ensure
+        FileUtils.rm_rf(wdir)
+      end
+    end
+  end
+
+  yield queue
+  $workers.times { queue << nil }
+  threads.each(&:join)
+end
+
+# Moves image of expression number num and its cost heatmap
+# from src_dir into dir.
+def store_image(num, dir, src_dir = ".")
+  if $frames > 0
+    store_frames(num, dir, src_dir)
+    return
+  end
+  ["", "-cost"].each do |suffix|
+    fi = File.join(src_dir, "FractalImage#{suffix}.png")
+    next unless File.exist?(fi)
+    FileUtils.mv(fi, File.join(dir, "FractalImage#{num}#{suffix}.png"))
+  end
+end
+
+VIDEO_FILE = "FractalVideo.ppm"
+
+# Frame K of sequence (and its heatmap) is moved into dir as
+# FractalImage<num>-K.png, stream of frames as FractalVideo<num>.ppm.
+def store_frames(num, dir, src_dir)
+  Dir.glob(File.join(src_dir, "FractalImage[0-9]*.png")).each do |fi|
+    FileUtils.mv(fi, File.join(dir, File.basename(fi).sub("FractalImage", "FractalImage#{num}-")))
   end
+  video = File.join(src_dir, VIDEO_FILE)
+  FileUtils.mv(video, File.join(dir, "FractalVideo#{num}.ppm")) if File.exist?(video)
 end
 
-def generate_image(method, expr, expr_diff)
-  fracmath = FRACMATH_FILE.sub(".raw", "")
-  File.open(fracmath, "w") do |f|
-    f << ERB.new(File.read(FRACMATH_FILE)).result(binding)
+# Moves images of batch rendered by FracGen (and their cost heatmaps) into dir.
+def store_batch_images(exprs, dir)
+  exprs.each do |e|
+    ["", "-cost"].each do |suffix|
+      fi = "FractalImage#{e[:num]}#{suffix}.png"
+      FileUtils.mv(fi, dir) if File.exist?(fi)
+    end
+  end
+end
+
+# Lanes are supported only by arithmetic and functions,
+# not by conditionals and absolute values.
+def lanes_supported?(expr)
+  !expr.include?("?") && !expr.include?("abs(")
+end
+
+# Source of FracMath.cpp for expression (nil for interpreter).
+def fracmath_source(method, expr, expr_diff)
+  expr = wrap_expr(expr) if expr.nil?
+  expr_diff = wrap_expr(expr_diff) if expr_diff.nil?
+  supported = lanes_supported?(expr) && lanes_supported?(expr_diff)
+  deep_zoom = $deep && supported
+  if $deep && !supported
+    warn "Deep zoom is unavailable for expressions with conditionals or absolute values"
+  end
+  batch_width = $simd && supported && !deep_zoom ? "DefaultLanes<IterFloatType>" : "0"
+  code = ExprCode.codegen(expr, expr_diff)
+  expr_code = code[:fn]
+  expr_diff_code = code[:diff]
+  expr_fused_code = code[:fused]
+  ERB.new(File.read(FRACMATH_FILE)).result(binding)
+end
+
+def build_fracgen(method, expr, expr_diff, build_dir = ".")
+  fracmath = File.join(build_dir, FRACMATH_FILE.sub(".raw", ""))
+  write_if_changed(fracmath, fracmath_source(method, expr, expr_diff))
+  fail "Bad make" unless system("make", "-C", build_dir, "FracGen")
+end
+
+# Compiles expression into module of $modules unless it is there
+# already and returns its path. Module is named by hash of everything
+# it is built from: its source, headers, Makefile and compiler flags.
+def build_module(method, expr, expr_diff, build_dir = ".")
+  source = fracmath_source(method, expr, expr_diff)
+  hash = Digest::SHA256.new
+  hash << source
+  headers = Dir.glob(File.join(build_dir, "*.{h,hpp}")).sort
+  (headers + [File.join(build_dir, "Makefile")]).each do |f|
+    hash << File.basename(f) << File.read(f)
+  end
+  ["CXX", "CXXFLAGS", "MAKEFLAGS"].each { |v| hash << "#{v}=#{ENV[v]}" }
+  key = hash.hexdigest
+  so = File.join($modules, "#{key}.so")
+  return so if File.exist?(so)
+
+  src = File.join($modules, "#{key}.cpp")
+  File.write(src, source)
+  # Other run may build the same module meanwhile, so it appears at once.
+  tmp = "#{so}.#{Process.pid}.#{Thread.current.object_id}"
+  begin
+    fail "Bad make" unless system("make", "-C", build_dir, "module",
+                                  "MODULE_SRC=#{src}", "MODULE=#{tmp}")
+    File.rename(tmp, so)
+  ensure
+    FileUtils.rm_f([src, tmp])
+  end
+  so
+end
+
+# FracGen --serve of every work directory, started on first use.
+$hosts = {}
+$hosts_lock = Mutex.new
+
+at_exit do
+  $hosts.each_value do |host|
+    host.close unless host.closed?
+  end
+end
+
+# Renders image in work_dir by FracGen started once for it. Returns
+# whether FracGen succeeded or nil if it died.
+def host_render(work_dir, args)
+  host = $hosts_lock.synchronize do
+    $hosts[work_dir] ||= IO.popen([File.expand_path("FracGen"), "--serve"], "r+",
+                                  chdir: work_dir)
+  end
+  host.puts(args.join("\t"))
+  host.flush
+  while (line = host.gets)
+    return $1 == "0" if line =~ /^done (\d+)$/
+    print line
+  end
+  $hosts_lock.synchronize { $hosts.delete(work_dir) }
+  host.close
+  nil
+rescue Errno::EPIPE
+  $hosts_lock.synchronize { $hosts.delete(work_dir) }
+  nil
+end
+
+# Options of FracGen which don't depend on expression.
+def fracgen_opts
+  opts = [*$image_opts, "--threads=#{$threads}", "--band=#{$band}"]
+  opts << "--stop-cycles" if $stop_cycles
+  opts << "--adaptive" if $adaptive
+  opts << "--antialias=#{$antialias}" if $antialias > 0
+  opts << "--palette=#{$palette}" if $palette
+  opts << "--no-tone-map" if $no_tone_map
+  opts << "--cache=#{$cache}" if $cache
+  opts << "--profile" if $profile
+  opts << "--heatmap" if $heatmap
+  if $frames > 0
+    opts << "--frames=#{$frames}"
+    opts << "--end-x=#{$end_c_x}" if $end_c_x
+    opts << "--end-y=#{$end_c_y}" if $end_c_y
+    opts << "--end-scale=#{$end_scale}" if $end_scale
+    opts << "--video=#{VIDEO_FILE}" if $video
+  end
+  opts
+end
+
+# Number of expression is also seed of image for methods with random state.
+# Image is written into work_dir.
+def generate_image(method, expr, expr_diff, num, work_dir = ".")
+  if $interpret
+    # Expression is passed to FracGen so it is built only once.
+    unless $fracgen_built
+      build_fracgen(method, nil, nil)
+      $fracgen_built = true
+    end
+    res = system(File.expand_path("FracGen"), *fracgen_opts, "--seed=#{num}",
+                 "--expr=#{expr}", "--diff-expr=#{expr_diff}", chdir: work_dir)
+  elsif $modules
+    # Only expression is compiled, FracGen keeps running.
+    unless $fracgen_built
+      build_fracgen(method, nil, nil)
+      $fracgen_built = true
+    end
+    so = build_module(method, expr, expr_diff, work_dir)
+    res = host_render(work_dir, [*fracgen_opts, "--seed=#{num}", "--module=#{so}"])
+  else
+    build_fracgen(method, expr, expr_diff, work_dir)
+    res = system("./FracGen", *fracgen_opts, "--seed=#{num}", chdir: work_dir)
   end
-  res = system("make FracGen && ./FracGen")
   if res.nil?
     fail "Bad make or fracgen"
   end
 end
 
+BATCH_FILE = "FracGenBatch.txt"
+
+# Renders expressions by single FracGen process. They are passed
+# in the same format as in config, header is not needed.
+def generate_batch(method, exprs)
+  unless $fracgen_built
+    build_fracgen(method, nil, nil)
+    $fracgen_built = true
+  end
+  batch = Config::Config.new(file: BATCH_FILE, read: false)
+  batch.save_empty_header
+  exprs.each { |e| batch.save_expr(**e) }
+  batch.close
+  res = system("./FracGen", *fracgen_opts, "--config=#{BATCH_FILE}")
+  File.delete(BATCH_FILE)
+  if res.nil?
+    fail "Bad fracgen"
+  end
+end
+
 $stop = false
 
 Signal.trap("INT") do
@@ -302,6 +659,48 @@ end
 # Clean up directory before generation.
 system("make clean")
 
+$threads = (options[:threads] || 0).to_i
+$batch = (options[:batch] || 0).to_i
+$workers = (options[:workers] || 1).to_i
+if $batch > 0 && $workers > 1
+  fail "Batches and workers can't be combined"
+end
+# Cores are shared between workers.
+if $threads == 0 && $workers > 1
+  $threads = [Etc.nprocessors / $workers, 1].max
+end
+$interpret = options[:interpret] == true || $batch > 0
+$modules = options[:modules] && File.expand_path(options[:modules])
+if $modules
+  fail "Modules can't be combined with interpretation or batches" if $interpret
+  FileUtils.mkdir_p($modules)
+end
+$simd = options[:simd] == true
+$deep = options[:deep] == true
+if $deep && $interpret
+  fail "Deep zoom needs compiled expressions, it can't be combined with interpretation or batches"
+end
+$band = (options[:band] || 0).to_i
+$stop_cycles = options[:stop_cycles] == true
+$adaptive = options[:adaptive] == true
+$antialias = (options[:antialias] || 0).to_i
+$palette = options[:palette]
+$no_tone_map = options[:no_tone_map] == true
+$cache = options[:cache] && File.expand_path(options[:cache])
+$profile = options[:profile] == true
+$screen = options[:screen] == true
+$min_converged = options[:min_converged]
+$min_entropy = options[:min_entropy]
+$heatmap = options[:heatmap] == true
+$frames = (options[:frames] || 0).to_i
+$end_c_x = options[:end_c_x]
+$end_c_y = options[:end_c_y]
+$end_scale = options[:end_scale]
+$video = options[:video] == true
+if $frames > 0 && ($batch > 0 || $band > 0 || $cache)
+  fail "Sequence can't be combined with batches, bands or cache"
+end
+
 config = options[:cfg]
 
 if config